@@ -0,0 +1,574 @@
+// Micro-benchmarks of the IBMF driver hot paths.
+//
+// Usage: ibmf_bench [--filter <text>] [--min-time <seconds>] [font.ibmf]
+//
+// Without a font file, a synthetic font (fixed seed) is used, such that the
+// results are repeatable from one run to the other. Results are written to
+// stdout in JSON format: for each benchmark, the time per operation, the
+// throughput and the number of memory allocations per operation.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "IBMFDriver/IBMFFontMod.hpp"
+#include "IBMFDriver/RLEExtractor.hpp"
+#include "IBMFDriver/RLEGenerator.hpp"
+
+// ----- Allocation counting -----
+
+static std::atomic<uint64_t> allocCount{0};
+static std::atomic<uint64_t> allocBytes{0};
+
+// Both forms of new allocate with malloc directly, to match the frees of
+// the replacement deletes.
+static auto countedAlloc(size_t size) -> void * {
+  allocCount.fetch_add(1, std::memory_order_relaxed);
+  allocBytes.fetch_add(size, std::memory_order_relaxed);
+  if (void *ptr = malloc(size == 0 ? 1 : size)) return ptr;
+  throw std::bad_alloc();
+}
+
+void *operator new(size_t size) { return countedAlloc(size); }
+void *operator new[](size_t size) { return countedAlloc(size); }
+void  operator delete(void *ptr) noexcept { free(ptr); }
+void  operator delete[](void *ptr) noexcept { free(ptr); }
+void  operator delete(void *ptr, size_t) noexcept { free(ptr); }
+void  operator delete[](void *ptr, size_t) noexcept { free(ptr); }
+
+// ----- Synthetic font -----
+
+// A UTF32 font with random glyph bitmaps (some rows repeated, to exercise the
+// RLE repeat counts) and a sparse set of ligatures and kerning pairs.
+
+class BenchFont : public IBMFFontMod {
+public:
+  static constexpr int FACE_COUNT  = 4;
+  static constexpr int GLYPH_COUNT = 600;
+
+  BenchFont(unsigned int seed) {
+    std::mt19937 rng(seed);
+
+    memcpy(preamble_.marker, "IBMF", 4);
+    preamble_.faceCount       = FACE_COUNT;
+    preamble_.bits.version    = IBMF_VERSION;
+    preamble_.bits.fontFormat = FontFormat::UTF32;
+
+    // Two bundles in plane 0: Basic Latin and part of Cyrillic
+    constexpr int half = GLYPH_COUNT / 2;
+    planes_            = {
+        Plane{.codePointBundlesIdx = 0, .entriesCount = 2, .firstGlyphCode = 0},
+        Plane{.codePointBundlesIdx = 2, .entriesCount = 0, .firstGlyphCode = GLYPH_COUNT},
+        Plane{.codePointBundlesIdx = 2, .entriesCount = 0, .firstGlyphCode = GLYPH_COUNT},
+        Plane{.codePointBundlesIdx = 2, .entriesCount = 0, .firstGlyphCode = GLYPH_COUNT}};
+    codePointBundles_ = {
+        CodePointBundle{.firstCodePoint = 0x0021, .lastCodePoint = 0x0021 + half - 1},
+        CodePointBundle{.firstCodePoint = 0x0400, .lastCodePoint = 0x0400 + GLYPH_COUNT - half - 1}};
+
+    for (int faceIdx = 0; faceIdx < FACE_COUNT; faceIdx++) {
+      FacePtr face = FacePtr(new Face);
+      face->header = FaceHeaderPtr(new FaceHeader({
+          .pointSize        = static_cast<uint8_t>(8 + (faceIdx * 2)),
+          .lineHeight       = 40,
+          .dpi              = 300,
+          .xHeight          = 16 << 6,
+          .emSize           = 32 << 6,
+          .slantCorrection  = 0,
+          .descenderHeight  = 8,
+          .spaceSize        = 8,
+          .glyphCount       = GLYPH_COUNT,
+          .ligKernStepCount = 0, // will be set at save time
+          .pixelsPoolSize   = 0, // will be set at save time
+      }));
+
+      for (int glyphCode = 0; glyphCode < GLYPH_COUNT; glyphCode++) {
+        uint8_t width  = (glyphCode % 17 == 0) ? 0 : 1 + (rng() % 24);
+        uint8_t height = (width == 0) ? 0 : 1 + (rng() % 32);
+
+        BitmapPtr bitmap = BitmapPtr(new Bitmap(Dim(width, height)));
+        int       pattern = rng() % 3;
+        for (int row = 0; row < height; row++) {
+          if ((row > 0) && ((rng() % 3) == 0)) {
+            memcpy(bitmap->rowPtr(row), bitmap->rowPtr(row - 1), bitmap->rowSize());
+            continue;
+          }
+          for (int col = 0; col < width; col++) {
+            bool black = (pattern == 0)   ? (rng() % 2) != 0
+                         : (pattern == 1) ? (((col / 3) + (row / 4)) % 2) != 0
+                                          : (col > width / 4) && (col < (3 * width) / 4) &&
+                                                ((rng() % 8) != 0);
+            bitmap->setPixel(col, row, black);
+          }
+        }
+
+        GlyphLigKern glyphLigKern;
+        if (glyphCode % 28 == 0) {
+          glyphLigKern.ligSteps.push_back(GlyphLigStep{
+              .nextGlyphCode        = static_cast<GlyphCode>(rng() % GLYPH_COUNT),
+              .replacementGlyphCode = static_cast<GlyphCode>(rng() % GLYPH_COUNT)});
+        }
+        int kernCount = (glyphCode % 4 != 0) ? 0 : rng() % 12;
+        for (int i = 0; i < kernCount; i++) {
+          glyphLigKern.kernSteps.push_back(
+              GlyphKernStep{.nextGlyphCode = static_cast<GlyphCode>((rng() % 16) * 3),
+                            .kern          = static_cast<FIX16>(-static_cast<int>(rng() % 4) * 32)});
+        }
+
+        face->glyphs.push_back(GlyphInfo{
+            .bitmapWidth      = width,
+            .bitmapHeight     = height,
+            .horizontalOffset = static_cast<int8_t>(rng() % 3),
+            .verticalOffset   = static_cast<int8_t>(height - 2),
+            .packetLength     = 0, // will be set at save time
+            .advance          = static_cast<FIX16>((width + 1) << 6),
+            .rleMetrics       = RLEMetrics{.dynF = 0, .firstIsBlack = false, .filler = 0},
+            .ligKernPgmIndex  = 0, // will be set at save time
+            .mainCode         = static_cast<GlyphCode>(glyphCode)});
+        face->bitmaps.push_back(bitmap);
+        face->addGlyphLigKern(glyphLigKern);
+      }
+      faces_.push_back(std::move(face));
+    }
+  }
+};
+
+// Gives access to the lig/kern vectors preparation of a loaded font.
+
+class BenchFontMod : public IBMFFontMod {
+public:
+  BenchFontMod(uint8_t *memoryFont, uint32_t size) : IBMFFontMod(memoryFont, size) {}
+
+  using IBMFFontMod::prepareLigKernVectors;
+
+  // As if every glyph had been edited, for the whole save work to be done.
+  auto setModified() -> void {
+    for (auto &face : faces_) {
+      face->modified        = true;
+      face->ligKernModified = true;
+      face->modifiedBitmaps.assign(face->glyphs.size(), true);
+    }
+  }
+};
+
+// ----- Benchmark runner -----
+
+struct BenchResult {
+  std::string name;
+  uint64_t    iterations;
+  double      nsPerOp;
+  double      bytesPerSecond;
+  double      allocsPerOp;
+  double      allocBytesPerOp;
+};
+
+static std::vector<BenchResult> results;
+static std::string              filter;
+static double                   minTime     = 0.2; // Seconds per measurement
+static constexpr int            REPETITIONS = 5;
+
+// Runs fn (that executes opsPerCall operations, processing bytesPerCall
+// bytes) enough times to last minTime seconds, REPETITIONS times. The median
+// repetition is reported.
+
+static auto bench(const std::string &name, uint64_t opsPerCall, uint64_t bytesPerCall,
+                  const std::function<void()> &fn) -> void {
+  if (!filter.empty() && (name.find(filter) == std::string::npos)) return;
+
+  typedef std::chrono::steady_clock clock;
+
+  fn(); // warm-up
+
+  uint64_t calls = 1;
+  while (true) {
+    auto start = clock::now();
+    for (uint64_t i = 0; i < calls; i++) fn();
+    double elapsed = std::chrono::duration<double>(clock::now() - start).count();
+    if ((elapsed >= (minTime / 4)) || (calls >= (1ULL << 40))) {
+      calls = std::max<uint64_t>(1, static_cast<uint64_t>(calls * (minTime / elapsed)));
+      break;
+    }
+    calls *= 2;
+  }
+
+  std::vector<BenchResult> runs;
+  for (int rep = 0; rep < REPETITIONS; rep++) {
+    uint64_t allocCountStart = allocCount.load();
+    uint64_t allocBytesStart = allocBytes.load();
+    auto     start           = clock::now();
+    for (uint64_t i = 0; i < calls; i++) fn();
+    double   elapsed = std::chrono::duration<double>(clock::now() - start).count();
+    uint64_t ops     = calls * opsPerCall;
+    runs.push_back(BenchResult{
+        .name            = name,
+        .iterations      = ops,
+        .nsPerOp         = (elapsed * 1e9) / ops,
+        .bytesPerSecond  = (elapsed > 0) ? (calls * bytesPerCall) / elapsed : 0,
+        .allocsPerOp     = static_cast<double>(allocCount.load() - allocCountStart) / ops,
+        .allocBytesPerOp = static_cast<double>(allocBytes.load() - allocBytesStart) / ops});
+  }
+  std::sort(runs.begin(), runs.end(),
+            [](const BenchResult &a, const BenchResult &b) { return a.nsPerOp < b.nsPerOp; });
+  results.push_back(runs[REPETITIONS / 2]);
+}
+
+// Prevents the compiler from optimizing away the benchmarked computations.
+
+static volatile uint64_t sink;
+
+// ----- Benchmarks -----
+
+static auto benchRLE(IBMFFontMod &font) -> void {
+  struct Entry {
+    BitmapPtr  bitmap;
+    RLEBitmap  compressed;
+    RLEMetrics metrics;
+  };
+  std::vector<Entry> entries;
+  uint64_t           bitmapBytes = 0;
+
+  // All non-empty glyphs of the first face
+
+  for (int glyphCode = 0; glyphCode < font.getFaceHeader(0)->glyphCount; glyphCode++) {
+    GlyphInfoPtr glyphInfo;
+    BitmapPtr    bitmap;
+    if (!font.getGlyph(0, glyphCode, glyphInfo, &bitmap) || (bitmap->dim.width == 0) ||
+        (bitmap->dim.height == 0)) {
+      continue;
+    }
+    RLEGenerator gen;
+    if (!gen.encodeBitmap(bitmap)) continue;
+    Entry entry;
+    entry.bitmap            = bitmap;
+    entry.compressed.pixels = *gen.getData();
+    entry.compressed.dim    = bitmap->dim;
+    entry.compressed.length = entry.compressed.pixels.size();
+    entry.metrics = RLEMetrics{
+        .dynF = gen.getDynF(), .firstIsBlack = gen.getFirstIsBlack(), .filler = 0};
+    bitmapBytes += bitmap->words.size() * sizeof(Bitmap::Word);
+    entries.push_back(entry);
+  }
+
+  RLEGenerator gen;
+  bench("rle/encodeBitmap", entries.size(), bitmapBytes, [&]() {
+    for (auto &entry : entries) {
+      gen.encodeBitmap(entry.bitmap);
+      sink = gen.getData()->size();
+    }
+  });
+
+  bench("rle/retrieveBitmap", entries.size(), bitmapBytes, [&]() {
+    for (auto &entry : entries) {
+      Bitmap       bitmap(entry.compressed.dim);
+      RLEExtractor rle;
+      rle.retrieveBitmap(entry.compressed, bitmap, Pos(0, 0), entry.metrics);
+      sink = bitmap.words[0];
+    }
+  });
+}
+
+static auto benchLoadSave(std::vector<uint8_t> &fontData) -> void {
+  bench("font/load", 1, fontData.size(), [&]() {
+    IBMFFontMod font(fontData.data(), fontData.size());
+    sink = font.isInitialized();
+  });
+
+  auto holder = std::shared_ptr<uint8_t>(new uint8_t[fontData.size()],
+                                         std::default_delete<uint8_t[]>());
+  memcpy(holder.get(), fontData.data(), fontData.size());
+  bench("font/load/inPlace", 1, fontData.size(), [&]() {
+    IBMFFontMod font(holder, fontData.size());
+    sink = font.isInitialized();
+  });
+
+  BenchFontMod         font(fontData.data(), fontData.size());
+  std::vector<uint8_t> out;
+  out.reserve(fontData.size());
+  bench("font/save", 1, fontData.size(), [&]() {
+    font.setModified();
+    out.clear();
+    VectorByteSink sinkOut(out);
+    font.save(sinkOut);
+    sink = out.size();
+  });
+
+  // A single glyph edited since the last save
+  GlyphInfoPtr glyphInfo;
+  BitmapPtr    bitmap;
+  font.getGlyph(0, 1, glyphInfo, &bitmap);
+  GlyphInfo info = *glyphInfo;
+  bench("font/save/oneGlyph", 1, fontData.size(), [&]() {
+    font.saveGlyph(0, 1, &info, bitmap);
+    out.clear();
+    VectorByteSink sinkOut(out);
+    font.save(sinkOut);
+    sink = out.size();
+  });
+
+  bench("font/prepareLigKernVectors", 1, 0, [&]() {
+    font.setModified();
+    sink = font.prepareLigKernVectors();
+  });
+
+  font.setLigKernOptimization(true);
+  bench("font/prepareLigKernVectors/optimized", 1, 0, [&]() {
+    font.setModified();
+    sink = font.prepareLigKernVectors();
+  });
+  font.setLigKernOptimization(false);
+}
+
+static auto benchLookups(IBMFFontMod &font) -> void {
+  int glyphCount = font.getFaceHeader(0)->glyphCount;
+
+  std::vector<char32_t> codePoints;
+  for (GlyphCode glyphCode = 0; glyphCode < glyphCount; glyphCode++) {
+    codePoints.push_back(font.getUTF32(glyphCode));
+  }
+
+  bench("lookup/ligKern", glyphCount * 16, 0, [&]() {
+    uint64_t count = 0;
+    for (GlyphCode glyphCode1 = 0; glyphCode1 < glyphCount; glyphCode1++) {
+      for (GlyphCode next = 0; next < 16; next++) {
+        GlyphCode glyphCode2 = (next * 3) % glyphCount;
+        FIX16     kern;
+        bool      kernPairPresent;
+        count += font.ligKern(0, glyphCode1, &glyphCode2, &kern, &kernPairPresent);
+        count += kernPairPresent;
+      }
+    }
+    sink = count;
+  });
+
+  bench("lookup/translate", codePoints.size(), 0, [&]() {
+    uint64_t count = 0;
+    for (auto codePoint : codePoints) count += font.translate(codePoint);
+    sink = count;
+  });
+
+  std::vector<GlyphCode> glyphCodes;
+  bench("lookup/translate/batch", codePoints.size(), 0, [&]() {
+    font.translate(codePoints, glyphCodes);
+    sink = glyphCodes.back();
+  });
+
+  std::string text;
+  for (auto codePoint : codePoints) {
+    if (codePoint < 0x80) {
+      text += static_cast<char>(codePoint);
+    } else if (codePoint < 0x800) {
+      text += static_cast<char>(0xC0 | (codePoint >> 6));
+      text += static_cast<char>(0x80 | (codePoint & 0x3F));
+    } else {
+      text += static_cast<char>(0xE0 | (codePoint >> 12));
+      text += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+      text += static_cast<char>(0x80 | (codePoint & 0x3F));
+    }
+  }
+  std::vector<char32_t> decoded;
+  bench("lookup/decodeUTF8", codePoints.size(), text.size(), [&]() {
+    IBMFFontMod::decodeUTF8(text.data(), text.size(), decoded);
+    sink = decoded.size();
+  });
+
+  bench("lookup/toGlyphCode", codePoints.size(), 0, [&]() {
+    uint64_t count = 0;
+    for (auto codePoint : codePoints) count += font.toGlyphCode(codePoint);
+    sink = count;
+  });
+
+  bench("lookup/getUTF32", glyphCount, 0, [&]() {
+    uint64_t count = 0;
+    for (GlyphCode glyphCode = 0; glyphCode < glyphCount; glyphCode++) {
+      count += font.getUTF32(glyphCode);
+    }
+    sink = count;
+  });
+}
+
+// Glyphs with kerning steps for most of the others, as found in text fonts
+// with many kerning pairs, for the lookups not to depend on the pgm length.
+static auto benchLongLigKern(std::vector<uint8_t> &fontData) -> void {
+  IBMFFontMod font(fontData.data(), fontData.size());
+  int         glyphCount = font.getFaceHeader(0)->glyphCount;
+
+  GlyphLigKern glyphLigKern;
+  for (GlyphCode glyphCode = 0; glyphCode < glyphCount; glyphCode += 2) {
+    glyphLigKern.kernSteps.push_back(GlyphKernStep{.nextGlyphCode = glyphCode, .kern = -64});
+  }
+  for (GlyphCode glyphCode = 0; glyphCode < glyphCount; glyphCode++) {
+    font.setGlyphLigKern(0, glyphCode, glyphLigKern);
+  }
+
+  bench("lookup/ligKern/longPgms", glyphCount * 16, 0, [&]() {
+    uint64_t count = 0;
+    for (GlyphCode glyphCode1 = 0; glyphCode1 < glyphCount; glyphCode1++) {
+      for (GlyphCode next = 0; next < 16; next++) {
+        GlyphCode glyphCode2 = (next * 7 + glyphCode1) % glyphCount;
+        FIX16     kern;
+        bool      kernPairPresent;
+        count += font.ligKern(0, glyphCode1, &glyphCode2, &kern, &kernPairPresent);
+        count += kernPairPresent;
+      }
+    }
+    sink = count;
+  });
+}
+
+static auto benchAutoKerning(IBMFFontMod &font) -> void {
+  struct Glyph {
+    GlyphInfoPtr info;
+    BitmapPtr    bitmap;
+  };
+  std::vector<Glyph> glyphs;
+  for (int glyphCode = 0; (glyphCode < font.getFaceHeader(0)->glyphCount) && (glyphs.size() < 32);
+       glyphCode++) {
+    Glyph glyph;
+    if (font.getGlyph(0, glyphCode, glyph.info, &glyph.bitmap) &&
+        (glyph.bitmap->dim.width > 0)) {
+      glyphs.push_back(glyph);
+    }
+  }
+
+  bench("kerning/computeAutoKerning", glyphs.size() * glyphs.size(), 0, [&]() {
+    int64_t total = 0;
+    for (auto &first : glyphs) {
+      for (auto &second : glyphs) {
+        total += IBMFFontMod::computeAutoKerning(*first.bitmap, *second.bitmap, *first.info,
+                                                 *second.info);
+      }
+    }
+    sink = total;
+  });
+
+  // Profiles computed once per glyph, as when laying out text
+  std::vector<IBMFFontMod::GlyphProfile> profiles(glyphs.size());
+  for (size_t i = 0; i < glyphs.size(); i++) {
+    IBMFFontMod::computeGlyphProfile(*glyphs[i].bitmap, profiles[i]);
+  }
+  bench("kerning/computeAutoKerning/profiles", glyphs.size() * glyphs.size(), 0, [&]() {
+    int64_t total = 0;
+    for (size_t first = 0; first < glyphs.size(); first++) {
+      for (size_t second = 0; second < glyphs.size(); second++) {
+        total += IBMFFontMod::computeAutoKerning(profiles[first], profiles[second],
+                                                 *glyphs[first].info, *glyphs[second].info);
+      }
+    }
+    sink = total;
+  });
+}
+
+// The whole font kerned, on a copy as kern steps are added to it. As done by
+// generateAutoKerning(), the pairs evaluated are the ones whose second glyph
+// is a main glyph.
+static auto benchGenerateAutoKerning(std::vector<uint8_t> &fontData) -> void {
+  IBMFFontMod            font(fontData.data(), fontData.size());
+  std::vector<GlyphCode> glyphCodes;
+  uint64_t               pairCount = 0;
+  for (int faceIdx = 0; faceIdx < font.getPreamble().faceCount; faceIdx++) {
+    uint64_t glyphCount = font.getFaceHeader(faceIdx)->glyphCount;
+    uint64_t mainCount  = 0;
+    while (glyphCodes.size() < glyphCount) glyphCodes.push_back(glyphCodes.size());
+    for (GlyphCode glyphCode = 0; glyphCode < glyphCount; glyphCode++) {
+      GlyphInfoPtr info;
+      BitmapPtr    bitmap;
+      font.getGlyph(faceIdx, glyphCode, info, &bitmap);
+      GlyphCode mainCode = info->mainCode;
+      if (font.getPreamble().bits.fontFormat == FontFormat::LATIN) {
+        mainCode &= LATIN_GLYPH_CODE_MASK;
+      }
+      if (mainCode == glyphCode) mainCount++;
+    }
+    pairCount += glyphCount * mainCount;
+  }
+  bench("kerning/generateAutoKerning", pairCount, 0, [&]() {
+    IBMFFontMod::AutoKerningStats stats = font.generateAutoKerning(glyphCodes, 16);
+    sink                                = stats.kernStepCount;
+  });
+}
+
+// ----- Main -----
+
+static auto jsonString(const std::string &str) -> std::string {
+  std::string result;
+  for (auto ch : str) {
+    if ((ch == '"') || (ch == '\\')) result += '\\';
+    result += ch;
+  }
+  return result;
+}
+
+static auto printResults(const std::string &fontName) -> void {
+  printf("{\n  \"font\": \"%s\",\n  \"benchmarks\": [\n", jsonString(fontName).c_str());
+  for (size_t i = 0; i < results.size(); i++) {
+    const BenchResult &r = results[i];
+    printf("    {\"name\": \"%s\", \"iterations\": %llu, \"ns_per_op\": %.2f, "
+           "\"bytes_per_second\": %.0f, \"allocs_per_op\": %.3f, \"alloc_bytes_per_op\": %.1f}%s\n",
+           r.name.c_str(), static_cast<unsigned long long>(r.iterations), r.nsPerOp,
+           r.bytesPerSecond, r.allocsPerOp, r.allocBytesPerOp,
+           (i + 1) < results.size() ? "," : "");
+  }
+  printf("  ]\n}\n");
+}
+
+int main(int argc, char **argv) {
+  std::string fontFilename;
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if ((arg == "--filter") && ((i + 1) < argc)) {
+      filter = argv[++i];
+    } else if ((arg == "--min-time") && ((i + 1) < argc)) {
+      minTime = atof(argv[++i]);
+    } else if ((arg.size() > 0) && (arg[0] != '-')) {
+      fontFilename = arg;
+    } else {
+      fprintf(stderr, "Usage: %s [--filter <text>] [--min-time <seconds>] [font.ibmf]\n",
+              argv[0]);
+      return 1;
+    }
+  }
+
+  std::vector<uint8_t> fontData;
+
+  if (fontFilename.empty()) {
+    BenchFont      synthetic(42);
+    VectorByteSink out(fontData);
+    if (!synthetic.save(out)) {
+      fprintf(stderr, "Unable to build the synthetic font: %s\n",
+              synthetic.getLastErrorMessage().c_str());
+      return 1;
+    }
+  } else {
+    std::ifstream in(fontFilename, std::ios::binary);
+    if (!in) {
+      fprintf(stderr, "Unable to open %s\n", fontFilename.c_str());
+      return 1;
+    }
+    fontData.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+  }
+
+  IBMFFontMod font(fontData.data(), fontData.size());
+  if (!font.isInitialized()) {
+    fprintf(stderr, "Unable to load the font\n");
+    return 1;
+  }
+
+  benchRLE(font);
+  benchLoadSave(fontData);
+  benchLookups(font);
+  benchLongLigKern(fontData);
+  benchAutoKerning(font);
+  benchGenerateAutoKerning(fontData);
+
+  printResults(fontFilename.empty() ? "synthetic" : fontFilename);
+
+  return 0;
+}
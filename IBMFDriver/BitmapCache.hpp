@@ -0,0 +1,133 @@
+#pragma once
+
+#include <list>
+#include <mutex>
+#include <set>
+#include <unordered_map>
+
+#include "IBMFDefs.hpp"
+
+using namespace IBMFDefs;
+
+/**
+ * @brief Bounded LRU cache of decompressed glyph bitmaps.
+ *
+ * Bitmaps are retrieved from the compressed (RLE) font data on demand and kept
+ * in this cache, keyed by face index and glyph code. When the memory used by the
+ * cached bitmaps goes beyond the budget, the least recently used ones are
+ * dropped. Pinned glyphs (the ones being edited) are never dropped.
+ *
+ * The cache is thread-safe.
+ */
+class BitmapCache {
+public:
+  static constexpr size_t DEFAULT_BUDGET = 8 * 1024 * 1024; // In bytes
+
+  BitmapCache(size_t budget = DEFAULT_BUDGET) : budget_(budget), size_(0) {}
+
+  auto get(int faceIndex, GlyphCode glyphCode) -> BitmapPtr {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto                        it = index_.find(key(faceIndex, glyphCode));
+    if (it == index_.end()) return nullptr;
+    lru_.splice(lru_.begin(), lru_, it->second);
+    return it->second->bitmap;
+  }
+
+  // Returns the cached bitmap, which is not the received one if another
+  // thread already put a bitmap for the same glyph.
+  auto put(int faceIndex, GlyphCode glyphCode, BitmapPtr bitmap) -> BitmapPtr {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Key                         k  = key(faceIndex, glyphCode);
+    auto                        it = index_.find(k);
+    if (it != index_.end()) {
+      lru_.splice(lru_.begin(), lru_, it->second);
+      return it->second->bitmap;
+    }
+    size_t entrySize = sizeof(Bitmap) + (bitmap->words.capacity() * sizeof(Bitmap::Word));
+    lru_.push_front(Entry{.key = k, .bitmap = bitmap, .size = entrySize});
+    index_[k] = lru_.begin();
+    size_ += entrySize;
+    evict();
+    return bitmap;
+  }
+
+  auto erase(int faceIndex, GlyphCode glyphCode) -> void {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto                        it = index_.find(key(faceIndex, glyphCode));
+    if (it != index_.end()) {
+      size_ -= it->second->size;
+      lru_.erase(it->second);
+      index_.erase(it);
+    }
+  }
+
+  auto pin(int faceIndex, GlyphCode glyphCode) -> void {
+    std::lock_guard<std::mutex> lock(mutex_);
+    pinned_.insert(key(faceIndex, glyphCode));
+  }
+
+  auto unpin(int faceIndex, GlyphCode glyphCode) -> void {
+    std::lock_guard<std::mutex> lock(mutex_);
+    pinned_.erase(key(faceIndex, glyphCode));
+    evict();
+  }
+
+  auto setBudget(size_t budget) -> void {
+    std::lock_guard<std::mutex> lock(mutex_);
+    budget_ = budget;
+    evict();
+  }
+
+  auto clear() -> void {
+    std::lock_guard<std::mutex> lock(mutex_);
+    lru_.clear();
+    index_.clear();
+    pinned_.clear();
+    size_ = 0;
+  }
+
+  auto getBudget() const -> size_t {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return budget_;
+  }
+
+  auto getSize() const -> size_t {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return size_;
+  }
+
+private:
+  typedef uint32_t Key;
+
+  struct Entry {
+    Key       key;
+    BitmapPtr bitmap;
+    size_t    size;
+  };
+  typedef std::list<Entry> Entries;
+
+  size_t budget_;
+  size_t size_;
+
+  Entries                                     lru_; // Most recently used first
+  std::unordered_map<Key, Entries::iterator> index_;
+  std::set<Key>                               pinned_;
+  mutable std::mutex                          mutex_;
+
+  static inline auto key(int faceIndex, GlyphCode glyphCode) -> Key {
+    return (static_cast<Key>(faceIndex) << 16) | glyphCode;
+  }
+
+  // Drop least recently used entries until the budget is respected.
+  // Pinned entries are skipped. Mutex must be locked by the caller.
+  auto evict() -> void {
+    auto it = lru_.end();
+    while ((size_ > budget_) && (it != lru_.begin())) {
+      --it;
+      if (pinned_.find(it->key) != pinned_.end()) continue;
+      size_ -= it->size;
+      index_.erase(it->key);
+      it = lru_.erase(it);
+    }
+  }
+};
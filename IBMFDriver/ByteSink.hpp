@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// A part of the output, as laid out by the font saving process. The data
+// belongs to the caller and must stay valid until written.
+
+struct ByteSegment {
+  const void *data;
+  size_t      size;
+};
+
+typedef std::vector<ByteSegment> ByteSegments;
+
+/**
+ * @brief Output of the font saving process.
+ *
+ * A plain sequence of bytes with a write position that can be moved back.
+ * The font is written in a single call, as a list of segments (gathered from
+ * the font structures) whose layout is computed beforehand.
+ */
+class ByteSink {
+public:
+  virtual ~ByteSink() {}
+
+  virtual auto write(const void *data, size_t size) -> bool = 0;
+  virtual auto pos() const -> size_t                       = 0;
+  virtual auto seek(size_t pos) -> bool                    = 0;
+
+  virtual auto write(const ByteSegments &segments) -> bool {
+    for (auto &segment : segments) {
+      if (!write(segment.data, segment.size)) return false;
+    }
+    return true;
+  }
+};
+
+// Bytes are written to a vector, that grows as required.
+
+class VectorByteSink : public ByteSink {
+public:
+  VectorByteSink(std::vector<uint8_t> &data) : data_(data), pos_(data.size()) {}
+
+  auto write(const void *data, size_t size) -> bool override {
+    if ((pos_ + size) > data_.size()) data_.resize(pos_ + size);
+    memcpy(&data_[pos_], data, size);
+    pos_ += size;
+    return true;
+  }
+
+  // The vector is resized once for all segments.
+  auto write(const ByteSegments &segments) -> bool override {
+    size_t size = 0;
+    for (auto &segment : segments) size += segment.size;
+    if ((pos_ + size) > data_.size()) data_.resize(pos_ + size);
+    for (auto &segment : segments) {
+      if (segment.size > 0) memcpy(&data_[pos_], segment.data, segment.size);
+      pos_ += segment.size;
+    }
+    return true;
+  }
+
+  inline auto pos() const -> size_t override { return pos_; }
+
+  auto seek(size_t pos) -> bool override {
+    if (pos > data_.size()) return false;
+    pos_ = pos;
+    return true;
+  }
+
+private:
+  std::vector<uint8_t> &data_;
+  size_t                pos_;
+};
+
+// Bytes are written to a file, created or truncated at construction time.
+
+class FileByteSink : public ByteSink {
+public:
+  FileByteSink(const std::string &filename) : file_(fopen(filename.c_str(), "wb")) {}
+  ~FileByteSink() { close(); }
+
+  inline auto isOpen() const -> bool { return file_ != nullptr; }
+
+  auto close() -> bool {
+    bool result = true;
+    if (file_ != nullptr) {
+      result = fclose(file_) == 0;
+      file_  = nullptr;
+    }
+    return result;
+  }
+
+  auto write(const void *data, size_t size) -> bool override {
+    return (file_ != nullptr) && (fwrite(data, 1, size, file_) == size);
+  }
+
+  inline auto pos() const -> size_t override {
+    return (file_ != nullptr) ? static_cast<size_t>(ftell(file_)) : 0;
+  }
+
+  auto seek(size_t pos) -> bool override {
+    return (file_ != nullptr) && (fseek(file_, static_cast<long>(pos), SEEK_SET) == 0);
+  }
+
+private:
+  FILE *file_;
+};
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <vector>
+
+#include "IBMFDefs.hpp"
+
+using namespace IBMFDefs;
+
+/**
+ * @brief Code point to glyph code translation of UTF32 fonts.
+ *
+ * Built from the planes and code point bundles of a font, it retrieves the
+ * glyph code of a code point in constant time. The first 4 planes are split in
+ * blocks of 256 code points. A block covered by at most one bundle is
+ * translated by an offset, the others through a page giving the glyph code of
+ * each of their code points. Only blocks shared by several bundles use a page,
+ * such that memory stays bounded for fonts with fragmented coverage.
+ *
+ * The reverse translation, from glyph code to code point, is a dense array.
+ */
+class CodePointTable {
+public:
+  // Retrieves NO_GLYPH_CODE for code points not in the font
+  inline auto find(char32_t codePoint) const -> GlyphCode {
+    uint32_t blockIdx = codePoint >> BLOCK_BITS;
+    if (blockIdx >= blocks_.size()) return NO_GLYPH_CODE;
+
+    const Block &block = blocks_[blockIdx];
+    uint32_t     low   = codePoint & BLOCK_MASK;
+    if (block.paged) return pages_[block.offset + low];
+    if ((low < block.first) || (low > block.last)) return NO_GLYPH_CODE;
+    return block.offset + low;
+  }
+
+  // Translation of a sequence of code points. As text mostly stays inside a
+  // Unicode block, the block of the previous code point is reused if possible.
+  auto find(const char32_t *codePoints, size_t count, GlyphCode *glyphCodes) const -> void {
+    uint32_t     blockIdx = UINT32_MAX;
+    const Block *block    = nullptr;
+    for (size_t i = 0; i < count; i++) {
+      if ((codePoints[i] >> BLOCK_BITS) != blockIdx) {
+        blockIdx = codePoints[i] >> BLOCK_BITS;
+        block    = (blockIdx < blocks_.size()) ? &blocks_[blockIdx] : nullptr;
+      }
+      uint32_t low = codePoints[i] & BLOCK_MASK;
+      if (block == nullptr) {
+        glyphCodes[i] = NO_GLYPH_CODE;
+      } else if (block->paged) {
+        glyphCodes[i] = pages_[block->offset + low];
+      } else if ((low < block->first) || (low > block->last)) {
+        glyphCodes[i] = NO_GLYPH_CODE;
+      } else {
+        glyphCodes[i] = block->offset + low;
+      }
+    }
+  }
+
+  // Retrieves 0 for glyph codes not in the font
+  inline auto codePoint(GlyphCode glyphCode) const -> char32_t {
+    return (glyphCode < codePoints_.size()) ? codePoints_[glyphCode] : 0;
+  }
+
+  auto build(const std::vector<Plane> &planes, const std::vector<CodePointBundle> &bundles)
+      -> void {
+    clear();
+    if (planes.size() < PLANE_COUNT) return;
+
+    blocks_.assign(PLANE_COUNT << (16 - BLOCK_BITS),
+                   Block{.offset = 0, .first = 1, .last = 0, .paged = false});
+
+    for (uint32_t planeIdx = 0; planeIdx < PLANE_COUNT; planeIdx++) {
+      const Plane &plane     = planes[planeIdx];
+      int          glyphCode = plane.firstGlyphCode;
+      for (int i = 0; i < plane.entriesCount; i++) {
+        const CodePointBundle &bundle    = bundles[plane.codePointBundlesIdx + i];
+        uint32_t               codePoint = (planeIdx << 16) | bundle.firstCodePoint;
+        uint32_t               last      = (planeIdx << 16) | bundle.lastCodePoint;
+        while (codePoint <= last) {
+          uint32_t blockLast = codePoint | BLOCK_MASK;
+          if (blockLast > last) blockLast = last;
+          addRange(codePoint, blockLast, glyphCode);
+          if (codePoints_.size() < (glyphCode + blockLast - codePoint + 1)) {
+            codePoints_.resize(glyphCode + blockLast - codePoint + 1, 0);
+          }
+          while (codePoint <= blockLast) codePoints_[glyphCode++] = codePoint++;
+        }
+      }
+    }
+  }
+
+  auto clear() -> void {
+    blocks_.clear();
+    pages_.clear();
+    codePoints_.clear();
+  }
+
+private:
+  static constexpr uint32_t PLANE_COUNT = 4; // Only the first 4 planes are managed
+  static constexpr uint32_t BLOCK_BITS  = 8;
+  static constexpr uint32_t BLOCK_SIZE  = 1 << BLOCK_BITS;
+  static constexpr uint32_t BLOCK_MASK  = BLOCK_SIZE - 1;
+
+  struct Block {
+    int32_t offset; // Page index in pages_ if paged, else glyph code of the block's code point 0
+    uint8_t first;  // Range of the block's code points in the font when not paged
+    uint8_t last;
+    bool    paged;
+  };
+
+  std::vector<Block>     blocks_; // Indexed by code point / BLOCK_SIZE
+  std::vector<GlyphCode> pages_;
+  std::vector<char32_t>  codePoints_; // Indexed by glyph code
+
+  // Code points first to last, inside a single block, translate to glyph codes
+  // starting at glyphCode.
+  auto addRange(uint32_t first, uint32_t last, int glyphCode) -> void {
+    Block   &block = blocks_[first >> BLOCK_BITS];
+    uint32_t low   = first & BLOCK_MASK;
+    uint32_t high  = last & BLOCK_MASK;
+
+    if (!block.paged && (block.first > block.last)) {
+      block = Block{.offset = static_cast<int32_t>(glyphCode - low),
+                    .first  = static_cast<uint8_t>(low),
+                    .last   = static_cast<uint8_t>(high),
+                    .paged  = false};
+      return;
+    }
+
+    if (!block.paged) {
+      int32_t page = pages_.size();
+      pages_.resize(pages_.size() + BLOCK_SIZE, NO_GLYPH_CODE);
+      for (uint32_t i = block.first; i <= block.last; i++) pages_[page + i] = block.offset + i;
+      block = Block{.offset = page, .first = 0, .last = 0, .paged = true};
+    }
+    for (uint32_t i = low; i <= high; i++) pages_[block.offset + i] = glyphCode + (i - low);
+  }
+};
@@ -1,7 +1,9 @@
 #pragma once
 
 #include <cinttypes>
+#include <cstring>
 #include <memory>
+#include <string>
 #include <vector>
 
 #include "../Unicode/UBlocks.hpp"
@@ -89,9 +91,6 @@ const constexpr uint8_t BLACK_EIGHT_BITS = 0xFF;
 const constexpr uint8_t WHITE_EIGHT_BITS = 0x00;
 
 enum FontFormat : uint8_t { LATIN = 0, UTF32 = 1, UNKNOWN = 7 };
-enum class PixelResolution : uint8_t { ONE_BIT, EIGHT_BITS };
-
-const constexpr PixelResolution resolution = PixelResolution::EIGHT_BITS;
 
 struct Dim {
   uint8_t width;
@@ -120,29 +119,213 @@ const constexpr GlyphCode SPACE_CODE    = 0x7FFE;
 // to be processed through the RLEExtractor class.
 // Dim contains the expected width and height once the bitmap has been
 // decompressed. The length is the pixels array size in bytes.
+//
+// When a font is loaded in place (memory-mapped), view points directly at
+// the compressed data inside the font memory and pixels stays empty.
 
 struct RLEBitmap {
-  Pixels   pixels;
-  Dim      dim;
-  uint16_t length;
-  void     clear() {
-        pixels.clear();
-        dim    = Dim(0, 0);
-        length = 0;
+  Pixels         pixels;
+  const uint8_t *view{nullptr};
+  Dim            dim;
+  uint16_t       length;
+  inline auto    data() const -> const uint8_t * { return view != nullptr ? view : pixels.data(); }
+  void           clear() {
+              pixels.clear();
+              view   = nullptr;
+              dim    = Dim(0, 0);
+              length = 0;
   }
 };
 typedef std::shared_ptr<RLEBitmap> RLEBitmapPtr;
 
 // Uncompressed Bitmap.
+//
+// Pixels are packed one bit per pixel, black pixels being 1, most significant
+// bit first in each byte: the IBMF one bit layout. Each row is padded to a
+// whole number of 64 bits words, such that rows can be compared, merged and
+// scanned a word at a time. Padding bits are always 0.
+//
+// getWord() and getBits() return the pixels of a word with the leftmost pixel
+// in the most significant bit, whatever the byte order of the processor.
 
 struct Bitmap {
-  Pixels pixels;
-  Dim    dim;
+  typedef uint64_t Word;
+  static constexpr int WORD_BITS = 64;
+
+  std::vector<Word> words;
+  Dim               dim;
+  int               wordsPerRow;
+
   Bitmap() { clear(); }
+  Bitmap(Dim d) { setDim(d); }
+
   void clear() {
-    pixels.clear();
-    dim = Dim(0, 0);
+    words.clear();
+    dim         = Dim(0, 0);
+    wordsPerRow = 0;
+  }
+
+  // Resize the bitmap, all pixels being white.
+  void setDim(Dim d) {
+    dim         = d;
+    wordsPerRow = (d.width + WORD_BITS - 1) / WORD_BITS;
+    words.assign(static_cast<size_t>(wordsPerRow) * d.height, 0);
+  }
+
+  // Set all pixels to white.
+  inline void clearPixels() { words.assign(words.size(), 0); }
+
+  inline auto rowSize() const -> int { return wordsPerRow * static_cast<int>(sizeof(Word)); }
+  inline auto rowPtr(int row) -> MemoryPtr {
+    return reinterpret_cast<MemoryPtr>(words.data() + (static_cast<size_t>(row) * wordsPerRow));
+  }
+  inline auto rowPtr(int row) const -> const uint8_t * {
+    return reinterpret_cast<const uint8_t *>(words.data() +
+                                             (static_cast<size_t>(row) * wordsPerRow));
+  }
+
+  inline auto getPixel(int col, int row) const -> bool {
+    return (rowPtr(row)[col >> 3] & (0x80 >> (col & 7))) != 0;
+  }
+  inline void setPixel(int col, int row, bool black) {
+    if (black) {
+      rowPtr(row)[col >> 3] |= 0x80 >> (col & 7);
+    } else {
+      rowPtr(row)[col >> 3] &= ~(0x80 >> (col & 7));
+    }
+  }
+
+  // Words are stored most significant byte first.
+  static inline auto loadWord(const uint8_t *ptr) -> Word {
+    Word word;
+    memcpy(&word, ptr, sizeof(Word));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    word = __builtin_bswap64(word);
+#endif
+    return word;
+  }
+  static inline void storeWord(uint8_t *ptr, Word word) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    word = __builtin_bswap64(word);
+#endif
+    memcpy(ptr, &word, sizeof(Word));
+  }
+
+  // Number of white pixels at the left of a word.
+  static inline auto countLeadingZeros(Word word) -> int {
+    return (word == 0) ? WORD_BITS : __builtin_clzll(word);
+  }
+
+  // The count leftmost pixels of a word (count in 0..64).
+  static inline auto leftMask(int count) -> Word {
+    return (count >= WORD_BITS) ? ~Word(0) : ~(~Word(0) >> count);
+  }
+
+  inline auto getWord(int row, int index) const -> Word {
+    return loadWord(rowPtr(row) + (index * sizeof(Word)));
+  }
+  inline void setWord(int row, int index, Word word) {
+    storeWord(rowPtr(row) + (index * sizeof(Word)), word);
+  }
+
+  // The 64 pixels starting at column col of a row. Pixels outside of the
+  // bitmap (col or row may be out of bounds) are white.
+  auto getBits(int row, int col) const -> Word {
+    if ((row < 0) || (row >= dim.height) || (col >= dim.width) || (col <= -WORD_BITS)) return 0;
+    int  index = (col >= 0) ? (col / WORD_BITS) : -1;
+    int  shift = col - (index * WORD_BITS);
+    Word first = (index >= 0) ? getWord(row, index) : 0;
+    if (shift == 0) return first;
+    Word second = ((index + 1) < wordsPerRow) ? getWord(row, index + 1) : 0;
+    return (first << shift) | (second >> (WORD_BITS - shift));
+  }
+
+  inline auto rowIsEmpty(int row) const -> bool {
+    const Word *ptr = words.data() + (static_cast<size_t>(row) * wordsPerRow);
+    for (int i = 0; i < wordsPerRow; i++) {
+      if (ptr[i] != 0) return false;
+    }
+    return true;
+  }
+
+  inline auto rowsAreEqual(int row1, int row2) const -> bool {
+    const Word *ptr1 = words.data() + (static_cast<size_t>(row1) * wordsPerRow);
+    const Word *ptr2 = words.data() + (static_cast<size_t>(row2) * wordsPerRow);
+    for (int i = 0; i < wordsPerRow; i++) {
+      if (ptr1[i] != ptr2[i]) return false;
+    }
+    return true;
+  }
+
+  auto isEmpty() const -> bool {
+    for (auto word : words) {
+      if (word != 0) return false;
+    }
+    return true;
   }
+
+  // Smallest rectangle containing all black pixels. Returns false if there is
+  // none.
+  auto getBlackBounds(int &left, int &top, int &right, int &bottom) const -> bool {
+    top = 0;
+    while ((top < dim.height) && rowIsEmpty(top)) top++;
+    if (top >= dim.height) return false;
+    bottom = dim.height - 1;
+    while (rowIsEmpty(bottom)) bottom--;
+
+    Word columns[(256 + WORD_BITS - 1) / WORD_BITS] = {0};
+    for (int row = top; row <= bottom; row++) {
+      const Word *ptr = words.data() + (static_cast<size_t>(row) * wordsPerRow);
+      for (int i = 0; i < wordsPerRow; i++) columns[i] |= ptr[i];
+    }
+    int first = 0;
+    while (columns[first] == 0) first++;
+    int last = wordsPerRow - 1;
+    while (columns[last] == 0) last--;
+
+    left  = (first * WORD_BITS) +
+           countLeadingZeros(loadWord(reinterpret_cast<const uint8_t *>(&columns[first])));
+    right = (last * WORD_BITS) + WORD_BITS - 1 -
+            __builtin_ctzll(loadWord(reinterpret_cast<const uint8_t *>(&columns[last])));
+    return true;
+  }
+
+  // OR the black pixels of a bitmap, its upper left corner being at column col
+  // and row row. The parts outside of this bitmap are clipped.
+  void merge(const Bitmap &from, int col, int row) {
+    for (int fromRow = 0; fromRow < from.dim.height; fromRow++) {
+      int toRow = row + fromRow;
+      if ((toRow < 0) || (toRow >= dim.height)) continue;
+      for (int index = 0; index < wordsPerRow; index++) {
+        int  toCol = index * WORD_BITS;
+        Word bits  = from.getBits(fromRow, toCol - col);
+        if (bits == 0) continue;
+        bits &= leftMask(dim.width - toCol);
+        setWord(toRow, index, getWord(toRow, index) | bits);
+      }
+    }
+  }
+
+  // A copy of a part of this bitmap, its upper left corner being at column
+  // col and row row.
+  auto extract(int col, int row, Dim d) const -> Bitmap {
+    Bitmap result(d);
+    for (int toRow = 0; toRow < d.height; toRow++) {
+      for (int index = 0; index < result.wordsPerRow; index++) {
+        int  toCol = index * WORD_BITS;
+        Word bits  = getBits(row + toRow, col + toCol);
+        bits &= leftMask(d.width - toCol);
+        result.setWord(toRow, index, bits);
+      }
+    }
+    return result;
+  }
+
+  inline auto operator==(const Bitmap &other) const -> bool {
+    return (dim.width == other.dim.width) && (dim.height == other.dim.height) &&
+           (words == other.words);
+  }
+  inline auto operator!=(const Bitmap &other) const -> bool { return !(*this == other); }
 };
 typedef std::shared_ptr<Bitmap> BitmapPtr;
 
@@ -444,17 +627,17 @@ struct GlyphKernStep {
   uint16_t nextGlyphCode;
   FIX16    kern;
 };
-typedef std::shared_ptr<GlyphKernStep> GlyphKernStepPtr;
-typedef std::vector<GlyphKernStepPtr>  GlyphKernSteps;
-typedef GlyphKernSteps                *GlyphKernStepsVecPtr;
+typedef std::vector<GlyphKernStep> GlyphKernSteps;
+typedef GlyphKernSteps            *GlyphKernStepsVecPtr;
 
 struct GlyphLigStep {
   uint16_t nextGlyphCode;
   uint16_t replacementGlyphCode;
 };
-typedef std::shared_ptr<GlyphLigStep> GlyphLigStepPtr;
-typedef std::vector<GlyphLigStepPtr>  GlyphLigSteps;
-typedef GlyphLigSteps                *GlyphLigStepsVecPtr;
+typedef std::vector<GlyphLigStep> GlyphLigSteps;
+typedef GlyphLigSteps            *GlyphLigStepsVecPtr;
+
+// An editable copy of the ligature and kerning steps of a glyph.
 
 struct GlyphLigKern {
   GlyphLigSteps  ligSteps;
@@ -462,12 +645,22 @@ struct GlyphLigKern {
 };
 typedef std::shared_ptr<GlyphLigKern> GlyphLigKernPtr;
 
+// Location of a glyph's ligature and kerning steps in the flat arrays
+// of a face.
+
+struct GlyphLigKernRange {
+  uint32_t firstLigStep;
+  uint32_t firstKernStep;
+  uint16_t ligStepCount;
+  uint16_t kernStepCount;
+};
+
 // These are the structure required to create a new font
 // from some parameters. For now, it is used to create UTF32
 // font format files.
 
 struct CharSelection {
-  QString                 filename; // Filename to import from
+  std::string             filename; // Filename to import from
   SelectedBlockIndexesPtr selectedBlockIndexes;
 };
 typedef std::vector<CharSelection>      CharSelections;
@@ -483,7 +676,7 @@ struct FontParameters {
   bool              pt17;
   bool              pt24;
   bool              pt48;
-  QString           filename;
+  std::string       filename;
   CharSelectionsPtr charSelections;
   bool              withKerning;
 };
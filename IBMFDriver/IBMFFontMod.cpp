@@ -1,31 +1,22 @@
 #include "IBMFFontMod.hpp"
 
+#include "ParallelFor.hpp"
+
 #include <algorithm>
 #include <iomanip>
 #include <iostream>
 
-#include <QIODevice>
-#include <QMessageBox>
-
 void IBMFFontMod::clear() {
   initialized_ = false;
-  for (auto &face : faces_) {
-    for (auto bitmap : face->bitmaps) {
-      bitmap->clear();
-    }
-    for (auto bitmap : face->compressedBitmaps) {
-      bitmap->clear();
-    }
-    face->glyphs.clear();
-    face->bitmaps.clear();
-    face->compressedBitmaps.clear();
-    face->glyphsLigKern.clear();
-    face->ligKernSteps.clear();
-  }
+  bitmapCache_.clear();
   faces_.clear();
   faceOffsets_.clear();
   planes_.clear();
   codePointBundles_.clear();
+  codePointTable_.clear();
+  memoryHolder_.reset();
+  warnings_.clear();
+  clearError();
 }
 
 bool IBMFFontMod::load() {
@@ -34,7 +25,7 @@ bool IBMFFontMod::load() {
   if (strncmp("IBMF", preamble_.marker, 4) != 0) return false;
   if (preamble_.bits.version != IBMF_VERSION) return false;
 
-  int idx = ((sizeof(Preamble) + preamble_.faceCount + 3) & 0xFFFFFFFC);
+  uint32_t idx = ((sizeof(Preamble) + preamble_.faceCount + 3) & 0xFFFFFFFC);
 
   // Faces offset retrieval
   for (int i = 0; i < preamble_.faceCount; i++) {
@@ -59,267 +50,403 @@ bool IBMFFontMod::load() {
     }
     idx +=
         (((*planes)[3].codePointBundlesIdx + (*planes)[3].entriesCount) * sizeof(CodePointBundle));
+
+    codePointTable_.build(planes_, codePointBundles_);
   } else {
     planes_.clear();
     codePointBundles_.clear();
   }
 
-  // Faces retrieval
+  // Faces offsets validation. Faces are laid out one after the other: each one
+  // must start where the previous one ends, and all of them must be inside
+  // the font memory.
   for (int i = 0; i < preamble_.faceCount; i++) {
-    if (idx != faceOffsets_[i]) return false;
-
-    // Face Header
-    FacePtr                       face   = FacePtr(new Face);
-    FaceHeaderPtr                 header = FaceHeaderPtr(new FaceHeader);
-    GlyphsPixelPoolIndexesTempPtr glyphsPixelPoolIndexes;
-    PixelsPoolTempPtr             pixelsPool;
-
-    memcpy(header.get(), &memory_[idx], sizeof(FaceHeader));
-    idx += sizeof(FaceHeader);
-
-    // Glyphs RLE bitmaps indexes in the bitmaps pool
-    glyphsPixelPoolIndexes = reinterpret_cast<GlyphsPixelPoolIndexesTempPtr>(&memory_[idx]);
-    idx += (sizeof(PixelPoolIndex) * header->glyphCount);
-
-    pixelsPool = reinterpret_cast<PixelsPoolTempPtr>(
-        &memory_[idx + (sizeof(GlyphInfo) * header->glyphCount)]);
-
-    // Glyphs info and bitmaps
-    face->glyphs.reserve(header->glyphCount);
-
-    for (int glyphCode = 0; glyphCode < header->glyphCount; glyphCode++) {
-      GlyphInfoPtr glyph_info = GlyphInfoPtr(new GlyphInfo);
-      memcpy(glyph_info.get(), &memory_[idx], sizeof(GlyphInfo));
-      idx += sizeof(GlyphInfo);
-
-      int       bitmap_size         = glyph_info->bitmapHeight * glyph_info->bitmapWidth;
-      BitmapPtr bitmap              = BitmapPtr(new Bitmap);
-      bitmap->pixels                = Pixels(bitmap_size, 0);
-      bitmap->dim                   = Dim(glyph_info->bitmapWidth, glyph_info->bitmapHeight);
-
-      RLEBitmapPtr compressedBitmap = RLEBitmapPtr(new RLEBitmap);
-      compressedBitmap->dim         = bitmap->dim;
-      compressedBitmap->pixels.reserve(glyph_info->packetLength);
-      compressedBitmap->length = glyph_info->packetLength;
-      for (int pos = 0; pos < glyph_info->packetLength; pos++) {
-        compressedBitmap->pixels.push_back(
-            (*pixelsPool)[pos + (*glyphsPixelPoolIndexes)[glyphCode]]);
-      }
-
-      RLEExtractor rle;
-      rle.retrieveBitmap(*compressedBitmap, *bitmap, Pos(0, 0), glyph_info->rleMetrics);
-      // retrieveBitmap(idx, glyph_info.get(), *bitmap, Pos(0,0));
+    if ((idx != faceOffsets_[i]) || ((idx + sizeof(FaceHeader)) > memoryLength_)) return false;
+
+    const FaceHeader *header = reinterpret_cast<const FaceHeader *>(&memory_[idx]);
+    size_t faceEnd = idx + sizeof(FaceHeader) +
+                     ((sizeof(PixelPoolIndex) + sizeof(GlyphInfo)) * header->glyphCount) +
+                     header->pixelsPoolSize + (sizeof(LigKernStep) * header->ligKernStepCount);
+    if (faceEnd > memoryLength_) return false;
+    idx = faceEnd;
+  }
 
-      face->glyphs.push_back(glyph_info);
-      face->bitmaps.push_back(bitmap);
-      face->compressedBitmaps.push_back(compressedBitmap);
+  // Faces retrieval. Being independent of each other, faces are decoded in
+  // parallel. The glyphs of each face are then decoded by the thread that
+  // decodes the face, except for single face fonts.
+  faces_.resize(preamble_.faceCount);
+  std::vector<uint8_t> faceLoaded(preamble_.faceCount, false);
 
-      // idx += glyph_info->packetLength;
+  parallelFor(0, preamble_.faceCount, 1, [&](size_t first, size_t last) {
+    for (size_t i = first; i < last; i++) {
+      faces_[i]     = FacePtr(new Face);
+      faceLoaded[i] = loadFace(faceOffsets_[i], *faces_[i]);
     }
+  });
 
-    if (&memory_[idx] != (uint8_t *)pixelsPool) {
+  for (auto loaded : faceLoaded) {
+    if (!loaded) {
+      faces_.clear();
       return false;
     }
+  }
+
+  return true;
+}
 
-    idx += header->pixelsPoolSize;
+// Calls stepFn for every ligature/kerning step of the glyph's program, as
+// found in the face's ligKernSteps, following the leading goTo if any.
+template <typename StepFn>
+auto IBMFFontMod::decodeLigKernPgm(const Face &face, GlyphCode glyphCode, StepFn stepFn) -> void {
+  if (face.glyphs[glyphCode].ligKernPgmIndex == 255) return;
 
-    if (header->ligKernStepCount > 0) {
-      face->ligKernSteps.reserve(header->ligKernStepCount);
-      for (int j = 0; j < header->ligKernStepCount; j++) {
-        LigKernStepPtr step = LigKernStepPtr(new LigKernStep);
-        memcpy(step.get(), &memory_[idx], sizeof(LigKernStep));
+  unsigned int lk_idx    = face.glyphs[glyphCode].ligKernPgmIndex;
+  unsigned int stepCount = face.ligKernSteps.size();
+  if (lk_idx >= stepCount) return;
 
-        face->ligKernSteps.push_back(step);
+  if ((face.ligKernSteps[lk_idx].b.goTo.isAGoTo) && (face.ligKernSteps[lk_idx].b.kern.isAKern)) {
+    lk_idx = face.ligKernSteps[lk_idx].b.goTo.displacement;
+  }
+  while (lk_idx < stepCount) {
+    const LigKernStep &step = face.ligKernSteps[lk_idx++];
+    stepFn(step);
+    if (step.a.data.stop) break;
+  }
+}
 
-        idx += sizeof(LigKernStep);
-      }
-    }
+auto IBMFFontMod::loadFace(uint32_t idx, Face &face) const -> bool {
+  // Face Header
+  FaceHeaderPtr                 header = FaceHeaderPtr(new FaceHeader);
+  GlyphsPixelPoolIndexesTempPtr glyphsPixelPoolIndexes;
+  PixelsPoolTempPtr             pixelsPool;
 
-    for (GlyphCode glyphCode = 0; glyphCode < header->glyphCount; glyphCode++) {
-      GlyphLigKernPtr glk = GlyphLigKernPtr(new GlyphLigKern);
+  memcpy(header.get(), &memory_[idx], sizeof(FaceHeader));
+  idx += sizeof(FaceHeader);
 
-      if (face->glyphs[glyphCode]->ligKernPgmIndex != 255) {
-        int lk_idx = face->glyphs[glyphCode]->ligKernPgmIndex;
-        if (lk_idx < header->ligKernStepCount) {
-          if ((face->ligKernSteps[lk_idx]->b.goTo.isAGoTo) &&
-              (face->ligKernSteps[lk_idx]->b.kern.isAKern)) {
-            lk_idx = face->ligKernSteps[lk_idx]->b.goTo.displacement;
-          }
-          do {
-            if (face->ligKernSteps[lk_idx]->b.kern.isAKern) { // true = kern, false = ligature
-              GlyphKernStepPtr step = GlyphKernStepPtr(new GlyphKernStep);
-              step->nextGlyphCode   = face->ligKernSteps[lk_idx]->a.data.nextGlyphCode;
-              step->kern            = face->ligKernSteps[lk_idx]->b.kern.kerningValue;
-              glk->kernSteps.push_back(step);
-            } else {
-              GlyphLigStepPtr step       = GlyphLigStepPtr(new GlyphLigStep);
-              step->nextGlyphCode        = face->ligKernSteps[lk_idx]->a.data.nextGlyphCode;
-              step->replacementGlyphCode = face->ligKernSteps[lk_idx]->b.repl.replGlyphCode;
-              glk->ligSteps.push_back(step);
-            }
-          } while (!face->ligKernSteps[lk_idx++]->a.data.stop);
+  // Glyphs RLE bitmaps indexes in the bitmaps pool
+  glyphsPixelPoolIndexes = reinterpret_cast<GlyphsPixelPoolIndexesTempPtr>(&memory_[idx]);
+  idx += (sizeof(PixelPoolIndex) * header->glyphCount);
+
+  pixelsPool = reinterpret_cast<PixelsPoolTempPtr>(
+      &memory_[idx + (sizeof(GlyphInfo) * header->glyphCount)]);
+
+  // Glyphs info, copied in a single block
+
+  const GlyphInfo *glyphInfos = reinterpret_cast<const GlyphInfo *>(&memory_[idx]);
+  face.glyphs.assign(glyphInfos, glyphInfos + header->glyphCount);
+  idx += (sizeof(GlyphInfo) * header->glyphCount);
+
+  if (&memory_[idx] != (uint8_t *)pixelsPool) {
+    return false;
+  }
+
+  // Compressed bitmaps. They are retrieved from the pixels pool when first
+  // required (see getGlyph())
+
+  face.pixelsPoolIndexes.assign(*glyphsPixelPoolIndexes,
+                                *glyphsPixelPoolIndexes + header->glyphCount);
+  if (memoryHolder_ != nullptr) {
+    face.pixelsPool = *pixelsPool;
+  } else {
+    face.pixelsPoolData.assign(*pixelsPool, *pixelsPool + header->pixelsPoolSize);
+    face.pixelsPool = face.pixelsPoolData.data();
+  }
+  face.bitmaps.resize(header->glyphCount, nullptr);
+  face.modifiedBitmaps.assign(header->glyphCount, false);
+
+  idx += header->pixelsPoolSize;
+
+  // Ligature and kerning steps
+
+  const LigKernStep *steps = reinterpret_cast<const LigKernStep *>(&memory_[idx]);
+  face.ligKernSteps.assign(steps, steps + header->ligKernStepCount);
+  idx += (sizeof(LigKernStep) * header->ligKernStepCount);
+
+  face.header          = header;
+  face.modified        = false;
+  face.ligKernModified = false;
+
+  // The glyphs lig/kern programs are decoded in two passes, each one done in
+  // parallel on ranges of glyphs for large faces, unless the faces themselves
+  // are loaded in parallel: the first pass counts the steps of each glyph,
+  // the second one fills the flat arrays at the location computed from those
+  // counts.
+
+  face.ligKernRanges.resize(header->glyphCount);
+
+  parallelFor(0, header->glyphCount, GLYPH_GRAIN_SIZE, [&](size_t first, size_t last) {
+    for (size_t glyphCode = first; glyphCode < last; glyphCode++) {
+      GlyphLigKernRange &range = face.ligKernRanges[glyphCode];
+      range = {.firstLigStep = 0, .firstKernStep = 0, .ligStepCount = 0, .kernStepCount = 0};
+      decodeLigKernPgm(face, glyphCode, [&range](const LigKernStep &step) {
+        if (step.b.kern.isAKern) {
+          range.kernStepCount += 1;
+        } else {
+          range.ligStepCount += 1;
         }
-      }
-      face->glyphsLigKern.push_back(glk);
+      });
     }
-
-    face->header = header;
-    faces_.push_back(std::move(face));
+  });
+
+  uint32_t ligStepCount  = 0;
+  uint32_t kernStepCount = 0;
+  for (auto &range : face.ligKernRanges) {
+    range.firstLigStep  = ligStepCount;
+    range.firstKernStep = kernStepCount;
+    ligStepCount += range.ligStepCount;
+    kernStepCount += range.kernStepCount;
   }
+  face.ligSteps.resize(ligStepCount);
+  face.kernSteps.resize(kernStepCount);
+
+  parallelFor(0, header->glyphCount, GLYPH_GRAIN_SIZE, [&](size_t first, size_t last) {
+    for (size_t glyphCode = first; glyphCode < last; glyphCode++) {
+      const GlyphLigKernRange &range    = face.ligKernRanges[glyphCode];
+      GlyphLigStep            *ligStep  = &face.ligSteps[range.firstLigStep];
+      GlyphKernStep           *kernStep = &face.kernSteps[range.firstKernStep];
+      decodeLigKernPgm(face, glyphCode, [&](const LigKernStep &step) {
+        if (step.b.kern.isAKern) { // true = kern, false = ligature
+          *kernStep++ = GlyphKernStep{.nextGlyphCode = step.a.data.nextGlyphCode,
+                                      .kern          = step.b.kern.kerningValue};
+        } else {
+          *ligStep++ = GlyphLigStep{.nextGlyphCode        = step.a.data.nextGlyphCode,
+                                    .replacementGlyphCode = step.b.repl.replGlyphCode};
+        }
+      });
+    }
+  });
 
   return true;
 }
 
-#define WRITE(v, size)                                                                             \
-  if (out.writeRawData((char *)v, size) == -1) {                                                   \
-    lastError_ = 1;                                                                                \
-    return false;                                                                                  \
-  }
+// The modified glyph bitmaps are compressed again before saving, and the
+// pixels pool of each modified face replaced with the result. The other
+// glyphs keep their compressed bitmap, copied from the current pool. The
+// glyphs of all faces are processed concurrently, by ranges of glyphs, each
+// range in its own buffer. The pools are then laid out from the buffer sizes
+// in glyph order, such that they are the same as with a serial encoding.
+
+auto IBMFFontMod::encodeBitmaps() -> bool {
+  struct GlyphRange {
+    int                  faceIndex;
+    size_t               first;
+    size_t               last;
+    std::vector<uint8_t> data;
+    bool                 completed;
+  };
 
-#define WRITE2(v, size)                                                                            \
-  if (out.writeRawData((char *)v, size) == -1) {                                                   \
-    lastError_ = 1;                                                                                \
-    poolIndexes->clear();                                                                          \
-    poolData->clear();                                                                             \
-    delete poolData;                                                                               \
-    delete poolIndexes;                                                                            \
-    return false;                                                                                  \
+  std::vector<GlyphRange> ranges;
+  for (int faceIndex = 0; faceIndex < static_cast<int>(faces_.size()); faceIndex++) {
+    Face &face = *faces_[faceIndex];
+    if (!face.modified) continue;
+    face.modifiedBitmaps.resize(face.glyphs.size(), true);
+    size_t glyphCount = face.glyphs.size();
+    for (size_t first = 0; first < glyphCount; first += ENCODE_GRAIN_SIZE) {
+      ranges.push_back(GlyphRange{.faceIndex = faceIndex,
+                                  .first     = first,
+                                  .last      = std::min(first + ENCODE_GRAIN_SIZE, glyphCount),
+                                  .data      = {},
+                                  .completed = false});
+    }
   }
 
-auto IBMFFontMod::save(QDataStream &out) -> bool {
+  // The glyphs information and the pools indexes are updated on copies: the
+  // bitmaps that are not in memory are retrieved from the current pixels
+  // pools using the current information. The indexes are relative to the
+  // range buffer until the pools are laid out.
+
+  std::vector<std::vector<GlyphInfo>>      glyphs(faces_.size());
+  std::vector<std::vector<PixelPoolIndex>> poolIndexes(faces_.size());
+  for (size_t faceIndex = 0; faceIndex < faces_.size(); faceIndex++) {
+    if (!faces_[faceIndex]->modified) continue;
+    glyphs[faceIndex] = faces_[faceIndex]->glyphs;
+    poolIndexes[faceIndex].assign(glyphs[faceIndex].size(), 0);
+  }
 
-  lastError_ = 0;
+  parallelFor(0, ranges.size(), 1, [&](size_t firstRange, size_t lastRange) {
+    // A single generator for all glyphs of the ranges, as it keeps its work
+    // vectors from one bitmap to the next.
+    RLEGenerator gen;
+
+    for (size_t rangeIndex = firstRange; rangeIndex < lastRange; rangeIndex++) {
+      GlyphRange &range = ranges[rangeIndex];
+      const Face &face  = *faces_[range.faceIndex];
+      for (size_t glyphCode = range.first; glyphCode < range.last; glyphCode++) {
+        GlyphInfo &glyph = glyphs[range.faceIndex][glyphCode];
+
+        if (!face.modifiedBitmaps[glyphCode] && (face.pixelsPool != nullptr)) {
+          const uint8_t *data = face.pixelsPool + face.pixelsPoolIndexes[glyphCode];
+          if (glyph.packetLength > 0) {
+            poolIndexes[range.faceIndex][glyphCode] = range.data.size();
+            range.data.insert(range.data.end(), data, data + glyph.packetLength);
+          }
+          continue;
+        }
 
-  if (!prepareLigKernVectors()) return false;
+        BitmapPtr bitmap = face.bitmaps[glyphCode];
+        if (bitmap == nullptr) bitmap = retrieveBitmap(range.faceIndex, glyphCode);
 
-  WRITE(&preamble_, sizeof(Preamble));
+        if (bitmap->dim.width == 0) {
+          glyph.rleMetrics.dynF         = 14;
+          glyph.rleMetrics.firstIsBlack = false;
+          glyph.packetLength            = 0;
+        } else {
+          if (!gen.encodeBitmap(bitmap)) return;
+          glyph.rleMetrics.dynF         = gen.getDynF();
+          glyph.rleMetrics.firstIsBlack = gen.getFirstIsBlack();
+          auto data                     = gen.getData();
+          glyph.packetLength            = data->size();
+          poolIndexes[range.faceIndex][glyphCode] = range.data.size();
+          range.data.insert(range.data.end(), data->begin(), data->end());
+        }
+      }
+      range.completed = true;
+    }
+  });
 
-  int fill = 4 - ((sizeof(Preamble) + preamble_.faceCount) & 3);
-  if (fill == 4) {
-    fill = 0;
-  }
-  char filler = 0;
-  for (auto &face : faces_) {
-    WRITE(&face->header->pointSize, 1);
-  }
-  while (fill--) {
-    WRITE(&filler, 1);
+  for (auto &range : ranges) {
+    if (!range.completed) return setError(3, "Unable to compress a glyph bitmap");
   }
 
-  uint32_t offset    = 0;
-  auto     offsetPos = out.device()->pos();
-  for (int i = 0; i < preamble_.faceCount; i++) {
-    WRITE(&offset, 4);
+  // The new pixels pools replace the current ones, to stay in sync with the
+  // glyphs information. The glyphs information is updated in place, such
+  // that references to it stay valid.
+
+  for (size_t faceIndex = 0; faceIndex < faces_.size(); faceIndex++) {
+    Face &face = *faces_[faceIndex];
+    if (!face.modified) continue;
+    face.pixelsPoolData.clear();
+    std::copy(glyphs[faceIndex].begin(), glyphs[faceIndex].end(), face.glyphs.begin());
+    face.pixelsPoolIndexes = std::move(poolIndexes[faceIndex]);
   }
 
-  if (preamble_.bits.fontFormat == FontFormat::UTF32) {
-    for (auto &plane : planes_) {
-      WRITE(&plane, sizeof(Plane));
-    }
-    for (auto &codePointBundle : codePointBundles_) {
-      WRITE(&codePointBundle, sizeof(CodePointBundle));
+  for (auto &range : ranges) {
+    Face  &face     = *faces_[range.faceIndex];
+    size_t poolSize = face.pixelsPoolData.size();
+    for (size_t glyphCode = range.first; glyphCode < range.last; glyphCode++) {
+      if (face.glyphs[glyphCode].packetLength > 0) face.pixelsPoolIndexes[glyphCode] += poolSize;
     }
+    face.pixelsPoolData.insert(face.pixelsPoolData.end(), range.data.begin(), range.data.end());
   }
 
+  // The pools are padded to keep the alignment of the next face to 32 bits
+  // offsets, as are the pools of the faces retrieved from a font file.
+
   for (auto &face : faces_) {
-    // Save current offset position as the location of the font face
-    auto pos = out.device()->pos();
-    out.device()->seek(offsetPos);
-    WRITE(&pos, 4);
-    offsetPos += 4;
-    out.device()->seek(pos);
-    if (out.device()->pos() != pos) {
-      lastError_ = 2;
-      return false;
-    }
+    if (!face->modified) continue;
+    size_t fill =
+        4 - ((face->pixelsPoolData.size() + (sizeof(GlyphInfo) * face->glyphs.size())) & 3);
+    if (fill == 4) fill = 0;
+    face->pixelsPoolData.resize(face->pixelsPoolData.size() + fill, 0);
+    face->header->pixelsPoolSize = face->pixelsPoolData.size();
+    face->pixelsPool             = face->pixelsPoolData.data();
+    std::fill(face->modifiedBitmaps.begin(), face->modifiedBitmaps.end(), false);
+  }
 
-    int                    idx         = 0;
-    int                    glyphCount  = 0;
-    std::vector<uint8_t>  *poolData    = new std::vector<uint8_t>();
-    std::vector<uint32_t> *poolIndexes = new std::vector<uint32_t>();
+  return true;
+}
 
-    for (auto &glyph : face->glyphs) {
-      if (face->bitmaps[idx]->dim.width == 0) {
-        glyph->rleMetrics.dynF         = 14;
-        glyph->rleMetrics.firstIsBlack = false;
-        glyph->packetLength            = 0;
-        poolIndexes->push_back(0);
-        idx += 1;
-      } else {
-        RLEGenerator *gen = new RLEGenerator;
-        if (!gen->encodeBitmap(face->bitmaps[idx++])) {
-          poolData->clear();
-          delete poolData;
-          poolIndexes->clear();
-          delete poolIndexes;
-
-          lastError_ = 3;
-          return false;
-        }
-        glyph->rleMetrics.dynF         = gen->getDynF();
-        glyph->rleMetrics.firstIsBlack = gen->getFirstIsBlack();
-        auto data                      = gen->getData();
-        glyph->packetLength            = data->size();
-        poolIndexes->push_back(poolData->size());
-        copy(data->begin(), data->end(), std::back_inserter(*poolData));
-        delete gen;
-      }
-    }
+// The layout of the whole font is computed first, as a list of segments
+// pointing at the font structures, written to the output in a single call.
 
-    fill = 4 - (poolData->size() + (sizeof(GlyphInfo) * face->header->glyphCount) &
-                3); // to keep alignment to 32bits offsets
-    if (fill == 4) fill = 0;
+auto IBMFFontMod::save(ByteSink &out) -> bool {
 
-    face->header->pixelsPoolSize   = poolData->size() + fill;
-    face->header->ligKernStepCount = face->ligKernSteps.size();
+  clearError();
 
-    WRITE2(face->header.get(), sizeof(FaceHeader));
+  if (!prepareLigKernVectors()) return false;
+  if (!encodeBitmaps()) return false;
 
-    for (auto idx : *poolIndexes) {
-      WRITE2(&idx, sizeof(uint32_t));
-    }
+  ByteSegments segments;
+  segments.reserve(5 + (5 * faces_.size()));
 
-    for (auto &glyph : face->glyphs) {
-      WRITE2(glyph.get(), sizeof(GlyphInfo));
-      glyphCount++;
-    }
+  auto add = [&segments](const void *data, size_t size) -> size_t {
+    segments.push_back(ByteSegment{.data = data, .size = size});
+    return size;
+  };
 
-    if (glyphCount != face->header->glyphCount) {
-      lastError_ = 5;
-      poolIndexes->clear();
-      poolData->clear();
-      delete poolData;
-      delete poolIndexes;
-      return false;
-    }
+  size_t pos = add(&preamble_, sizeof(Preamble));
+
+  // Faces point sizes, padded to keep the alignment to 32 bits offsets
+  std::vector<uint8_t> pointSizes(((pos + faces_.size() + 3) & ~static_cast<size_t>(3)) - pos, 0);
+  for (size_t i = 0; i < faces_.size(); i++) {
+    pointSizes[i] = faces_[i]->header->pointSize;
+  }
+  pos += add(pointSizes.data(), pointSizes.size());
+
+  std::vector<uint32_t> faceOffsets(faces_.size());
+  pos += add(faceOffsets.data(), faceOffsets.size() * sizeof(uint32_t));
 
-    WRITE2(poolData->data(), poolData->size());
-    while (fill--) {
-      WRITE2(&filler, 1);
+  if (preamble_.bits.fontFormat == FontFormat::UTF32) {
+    pos += add(planes_.data(), planes_.size() * sizeof(Plane));
+    pos += add(codePointBundles_.data(), codePointBundles_.size() * sizeof(CodePointBundle));
+  }
+
+  for (size_t i = 0; i < faces_.size(); i++) {
+    Face &face = *faces_[i];
+
+    if ((face.glyphs.size() != face.header->glyphCount) ||
+        (face.pixelsPoolIndexes.size() != face.header->glyphCount)) {
+      return setError(5, "Glyph count mismatch with face header");
+    }
+    if (face.ligKernSteps.size() > MAX_LIG_KERN_STEP_COUNT) {
+      return setError(9, "Too many lig/kern steps in a face");
     }
+    face.header->ligKernStepCount = face.ligKernSteps.size();
+
+    faceOffsets[i] = pos;
+    pos += add(face.header.get(), sizeof(FaceHeader));
+    pos += add(face.pixelsPoolIndexes.data(),
+               face.pixelsPoolIndexes.size() * sizeof(PixelPoolIndex));
+    pos += add(face.glyphs.data(), face.glyphs.size() * sizeof(GlyphInfo));
+    pos += add(face.pixelsPool, face.header->pixelsPoolSize);
+    pos += add(face.ligKernSteps.data(), face.ligKernSteps.size() * sizeof(LigKernStep));
+  }
 
-    poolIndexes->clear();
-    poolData->clear();
-    delete poolData;
-    delete poolIndexes;
+  if (!out.write(segments)) return setError(1, "Unable to write font data");
+
+  for (auto &face : faces_) {
+    face->modified = false;
+  }
+  return true;
+}
 
-    int ligKernCount = 0;
-    for (auto ligKern : face->ligKernSteps) {
-      WRITE(ligKern.get(), sizeof(LigKernStep));
-      ligKernCount += 1;
+auto IBMFFontMod::detachMemory() -> void {
+  if (memoryHolder_ == nullptr) return;
+
+  for (auto &face : faces_) {
+    if ((face->pixelsPool != nullptr) && (face->pixelsPool != face->pixelsPoolData.data())) {
+      face->pixelsPoolData.assign(face->pixelsPool,
+                                  face->pixelsPool + face->header->pixelsPoolSize);
+      face->pixelsPool = face->pixelsPoolData.data();
     }
+  }
+  memoryHolder_.reset();
+  memory_       = nullptr;
+  memoryLength_ = 0;
+}
 
-    if (ligKernCount != face->header->ligKernStepCount) {
-      lastError_ = 6;
-      return false;
+// The lig/kern steps of all faces are rebuilt at the next save.
+auto IBMFFontMod::setLigKernOptimization(bool optimize) -> void {
+  if (optimize != optimizeLigKern_) {
+    optimizeLigKern_ = optimize;
+    for (auto &face : faces_) {
+      face->modified        = true;
+      face->ligKernModified = true;
     }
   }
-  return true;
+}
+
+auto IBMFFontMod::isModified() const -> bool {
+  for (auto &face : faces_) {
+    if (face->modified) return true;
+  }
+  return false;
 }
 
 auto IBMFFontMod::saveFaceHeader(int faceIndex, FaceHeader &face_header) -> bool {
   if (faceIndex < preamble_.faceCount) {
     memcpy(faces_[faceIndex]->header.get(), &face_header, sizeof(FaceHeader));
+    faces_[faceIndex]->modified = true;
     return true;
   }
   return false;
@@ -329,10 +456,16 @@ auto IBMFFontMod::saveGlyph(int faceIndex, int glyphCode, GlyphInfo *newGlyphInf
                             BitmapPtr new_bitmap) -> bool {
   if ((faceIndex < preamble_.faceCount) && (glyphCode < faces_[faceIndex]->header->glyphCount)) {
 
-    int glyphIndex                         = glyphCode;
+    int   glyphIndex = glyphCode;
+    Face &face       = *faces_[faceIndex];
 
-    *faces_[faceIndex]->glyphs[glyphIndex] = *newGlyphInfo;
-    faces_[faceIndex]->bitmaps[glyphIndex] = new_bitmap;
+    face.glyphs[glyphIndex]  = *newGlyphInfo;
+    face.bitmaps[glyphIndex] = new_bitmap;
+    if (glyphIndex < static_cast<int>(face.modifiedBitmaps.size())) {
+      face.modifiedBitmaps[glyphIndex] = true;
+    }
+    face.modified = true;
+    bitmapCache_.erase(faceIndex, glyphCode);
     return true;
   }
   return false;
@@ -364,35 +497,30 @@ auto IBMFFontMod::ligKern(int faceIndex, const GlyphCode glyphCode1, GlyphCode *
   *kern            = 0;
   *kernPairPresent = false;
   //
-  const GlyphLigSteps  &ligSteps  = faces_[faceIndex]->glyphsLigKern[glyphCode1]->ligSteps;
-  const GlyphKernSteps &kernSteps = faces_[faceIndex]->glyphsLigKern[glyphCode1]->kernSteps;
+  const Face              &face  = *faces_[faceIndex];
+  const GlyphLigKernRange &range = face.ligKernRanges[glyphCode1];
 
-  if ((ligSteps.size() == 0) && (kernSteps.size() == 0)) {
+  if ((range.ligStepCount == 0) && (range.kernStepCount == 0)) {
     return false;
   }
 
-  GlyphCode code = faces_[faceIndex]->glyphs[*glyphCode2]->mainCode;
+  GlyphCode code = face.glyphs[*glyphCode2].mainCode;
   if (preamble_.bits.fontFormat == FontFormat::LATIN) {
     code &= LATIN_GLYPH_CODE_MASK;
   }
-  bool first = true;
 
-  for (auto &ligStep : ligSteps) {
-    if (ligStep->nextGlyphCode == code) {
-      *glyphCode2 = ligStep->replacementGlyphCode;
-      return true;
-    }
-  }
+  const LigKernPair *pair = face.findLigKernPair(glyphCode1, code);
+  if (pair == nullptr) return false;
 
-  for (auto &kernStep : kernSteps) {
-    if (kernStep->nextGlyphCode == code) {
-      FIX16 k = kernStep->kern;
-      if (k & 0x2000) k |= 0xC000;
-      *kern            = k;
-      *kernPairPresent = true;
-      return false;
-    }
+  if (pair->kind == LigKernPair::LIGATURE) {
+    *glyphCode2 = pair->value;
+    return true;
   }
+
+  FIX16 k = pair->value;
+  if (k & 0x2000) k |= 0xC000;
+  *kern            = k;
+  *kernPairPresent = true;
   return false;
 }
 
@@ -405,72 +533,894 @@ auto IBMFFontMod::getGlyphLigKern(int faceIndex, int glyphCode, GlyphLigKernPtr
     return false;
   }
 
-  *glyphLigKern = faces_[faceIndex]->glyphsLigKern[glyphCode];
+  *glyphLigKern = faces_[faceIndex]->getGlyphLigKern(glyphCode);
 
   return true;
 }
 
+// Replace the ligature and kerning steps of a glyph with the content of
+// glyphLigKern (usually an edited copy received from getGlyphLigKern()).
+auto IBMFFontMod::setGlyphLigKern(int faceIndex, int glyphCode, const GlyphLigKern &glyphLigKern)
+    -> bool {
+  if (faceIndex >= preamble_.faceCount) {
+    return false;
+  }
+  if (glyphCode >= faces_[faceIndex]->header->glyphCount) {
+    return false;
+  }
+
+  faces_[faceIndex]->setGlyphLigKern(glyphCode, glyphLigKern);
+
+  return true;
+}
+
+auto IBMFFontMod::Face::getGlyphLigKern(GlyphCode glyphCode) const -> GlyphLigKernPtr {
+  GlyphLigKernPtr glyphLigKern = GlyphLigKernPtr(new GlyphLigKern);
+
+  if (glyphCode < ligKernRanges.size()) {
+    const GlyphLigKernRange &range = ligKernRanges[glyphCode];
+    glyphLigKern->ligSteps.assign(ligSteps.begin() + range.firstLigStep,
+                                  ligSteps.begin() + range.firstLigStep + range.ligStepCount);
+    glyphLigKern->kernSteps.assign(kernSteps.begin() + range.firstKernStep,
+                                   kernSteps.begin() + range.firstKernStep + range.kernStepCount);
+  }
+
+  return glyphLigKern;
+}
+
+// Steps for the next glyph, as used by the importers, are added at the end of
+// the flat arrays.
+auto IBMFFontMod::Face::addGlyphLigKern(const GlyphLigKern &glyphLigKern) -> void {
+  modified        = true;
+  ligKernModified = true;
+
+  GlyphCode glyphCode = ligKernRanges.size();
+  ligKernRanges.push_back(GlyphLigKernRange{
+      .firstLigStep  = static_cast<uint32_t>(ligSteps.size()),
+      .firstKernStep = static_cast<uint32_t>(kernSteps.size()),
+      .ligStepCount  = static_cast<uint16_t>(glyphLigKern.ligSteps.size()),
+      .kernStepCount = static_cast<uint16_t>(glyphLigKern.kernSteps.size())});
+  ligSteps.insert(ligSteps.end(), glyphLigKern.ligSteps.begin(), glyphLigKern.ligSteps.end());
+  kernSteps.insert(kernSteps.end(), glyphLigKern.kernSteps.begin(), glyphLigKern.kernSteps.end());
+  if (ligKernPairsReady) indexLigKernPairs(glyphCode);
+}
+
+// The new steps of a glyph overwrite the current ones when they fit in their
+// range, else they are added at the end of the flat arrays. The entries left
+// unused are orphaned: the arrays are compacted once the orphaned entries
+// reach half the entries in use, such that repeated edits don't grow them.
+auto IBMFFontMod::Face::setGlyphLigKern(GlyphCode glyphCode, const GlyphLigKern &glyphLigKern)
+    -> void {
+  modified        = true;
+  ligKernModified = true;
+
+  if (glyphCode >= ligKernRanges.size()) {
+    ligKernRanges.resize(glyphCode + 1, GlyphLigKernRange{.firstLigStep  = 0,
+                                                          .firstKernStep = 0,
+                                                          .ligStepCount  = 0,
+                                                          .kernStepCount = 0});
+  }
+
+  if (ligKernPairsReady) unindexLigKernPairs(glyphCode);
+
+  GlyphLigKernRange &range = ligKernRanges[glyphCode];
+
+  if (glyphLigKern.ligSteps.size() > range.ligStepCount) {
+    orphanedStepCount += range.ligStepCount;
+    range.firstLigStep = ligSteps.size();
+    ligSteps.insert(ligSteps.end(), glyphLigKern.ligSteps.begin(), glyphLigKern.ligSteps.end());
+  } else {
+    orphanedStepCount += range.ligStepCount - glyphLigKern.ligSteps.size();
+    std::copy(glyphLigKern.ligSteps.begin(), glyphLigKern.ligSteps.end(),
+              ligSteps.begin() + range.firstLigStep);
+  }
+  range.ligStepCount = glyphLigKern.ligSteps.size();
+
+  if (glyphLigKern.kernSteps.size() > range.kernStepCount) {
+    orphanedStepCount += range.kernStepCount;
+    range.firstKernStep = kernSteps.size();
+    kernSteps.insert(kernSteps.end(), glyphLigKern.kernSteps.begin(),
+                     glyphLigKern.kernSteps.end());
+  } else {
+    orphanedStepCount += range.kernStepCount - glyphLigKern.kernSteps.size();
+    std::copy(glyphLigKern.kernSteps.begin(), glyphLigKern.kernSteps.end(),
+              kernSteps.begin() + range.firstKernStep);
+  }
+  range.kernStepCount = glyphLigKern.kernSteps.size();
+
+  if ((orphanedStepCount * 3) > (ligSteps.size() + kernSteps.size())) compactLigKernSteps();
+
+  if (ligKernPairsReady) indexLigKernPairs(glyphCode);
+}
+
+// The steps of the glyphs are moved to the start of the flat arrays, in glyph
+// order. The pairs index doesn't refer to the arrays and is kept as is.
+auto IBMFFontMod::Face::compactLigKernSteps() -> void {
+  size_t ligStepCount  = 0;
+  size_t kernStepCount = 0;
+  for (auto &range : ligKernRanges) {
+    ligStepCount += range.ligStepCount;
+    kernStepCount += range.kernStepCount;
+  }
+
+  std::vector<GlyphLigStep>  compactLigSteps;
+  std::vector<GlyphKernStep> compactKernSteps;
+  compactLigSteps.reserve(ligStepCount);
+  compactKernSteps.reserve(kernStepCount);
+
+  for (auto &range : ligKernRanges) {
+    auto ligStep  = ligSteps.begin() + range.firstLigStep;
+    auto kernStep = kernSteps.begin() + range.firstKernStep;
+    range.firstLigStep  = compactLigSteps.size();
+    range.firstKernStep = compactKernSteps.size();
+    compactLigSteps.insert(compactLigSteps.end(), ligStep, ligStep + range.ligStepCount);
+    compactKernSteps.insert(compactKernSteps.end(), kernStep, kernStep + range.kernStepCount);
+  }
+
+  ligSteps.swap(compactLigSteps);
+  kernSteps.swap(compactKernSteps);
+  orphanedStepCount = 0;
+}
+
+// ----- Ligature and kerning pairs index -----
+
+auto IBMFFontMod::Face::findLigKernPair(GlyphCode glyphCode, GlyphCode nextGlyphCode) const
+    -> const LigKernPair * {
+  if (!ligKernPairsReady.load(std::memory_order_acquire)) {
+    std::lock_guard<std::mutex> lock(ligKernPairsMutex);
+    if (!ligKernPairsReady.load(std::memory_order_relaxed)) {
+      ligKernPairs.clear(ligSteps.size() + kernSteps.size());
+      for (size_t glyphCode = 0; glyphCode < ligKernRanges.size(); glyphCode++) {
+        indexLigKernPairs(glyphCode);
+      }
+      ligKernPairsReady.store(true, std::memory_order_release);
+    }
+  }
+
+  return ligKernPairs.find(glyphCode, nextGlyphCode);
+}
+
+// Once built, the index follows the changes to the steps of a glyph.
+
+auto IBMFFontMod::Face::indexLigKernPairs(GlyphCode glyphCode) const -> void {
+  const GlyphLigKernRange &range   = ligKernRanges[glyphCode];
+
+  const GlyphLigStep      *ligStep = ligSteps.data() + range.firstLigStep;
+  for (int i = 0; i < range.ligStepCount; i++, ligStep++) {
+    ligKernPairs.insert(glyphCode, ligStep->nextGlyphCode, ligStep->replacementGlyphCode,
+                        LigKernPair::LIGATURE);
+  }
+
+  const GlyphKernStep *kernStep = kernSteps.data() + range.firstKernStep;
+  for (int i = 0; i < range.kernStepCount; i++, kernStep++) {
+    ligKernPairs.insert(glyphCode, kernStep->nextGlyphCode, kernStep->kern, LigKernPair::KERN);
+  }
+}
+
+auto IBMFFontMod::Face::unindexLigKernPairs(GlyphCode glyphCode) -> void {
+  const GlyphLigKernRange &range = ligKernRanges[glyphCode];
+
+  for (uint32_t i = 0; i < range.ligStepCount; i++) {
+    ligKernPairs.remove(glyphCode, ligSteps[range.firstLigStep + i].nextGlyphCode);
+  }
+  for (uint32_t i = 0; i < range.kernStepCount; i++) {
+    ligKernPairs.remove(glyphCode, kernSteps[range.firstKernStep + i].nextGlyphCode);
+  }
+}
+
 auto IBMFFontMod::getGlyph(int faceIndex, int glyphCode, GlyphInfoPtr &glyph_info,
                            BitmapPtr *bitmap) const -> bool {
   if (faceIndex >= preamble_.faceCount) return false;
-  if (glyphCode > faces_[faceIndex]->header->glyphCount) {
+  if (glyphCode >= faces_[faceIndex]->header->glyphCount) {
     return false;
   }
 
   int glyphIndex = glyphCode;
 
-  glyph_info     = faces_[faceIndex]->glyphs[glyphIndex];
+  glyph_info     = std::make_shared<GlyphInfo>(faces_[faceIndex]->glyphs[glyphIndex]);
   *bitmap        = faces_[faceIndex]->bitmaps[glyphIndex];
 
+  if (*bitmap == nullptr) {
+    if ((*bitmap = bitmapCache_.get(faceIndex, glyphCode)) == nullptr) {
+      *bitmap = bitmapCache_.put(faceIndex, glyphCode, retrieveBitmap(faceIndex, glyphIndex));
+    }
+  }
+
   return true;
 }
 
+// Decompress a glyph bitmap from the font data. The result is not put in the
+// bitmap cache.
+auto IBMFFontMod::retrieveBitmap(int faceIndex, int glyphCode) const -> BitmapPtr {
+  const Face      &face      = *faces_[faceIndex];
+  const GlyphInfo &glyphInfo = face.glyphs[glyphCode];
+
+  BitmapPtr bitmap = BitmapPtr(new Bitmap(Dim(glyphInfo.bitmapWidth, glyphInfo.bitmapHeight)));
+
+  if (face.pixelsPool != nullptr) {
+    RLEBitmap compressedBitmap;
+    compressedBitmap.view   = face.pixelsPool + face.pixelsPoolIndexes[glyphCode];
+    compressedBitmap.dim    = bitmap->dim;
+    compressedBitmap.length = glyphInfo.packetLength;
+
+    RLEExtractor rle;
+    rle.retrieveBitmap(compressedBitmap, *bitmap, Pos(0, 0), glyphInfo.rleMetrics);
+  }
+
+  return bitmap;
+}
+
+// Bitmaps are already one bit per pixel: this is a plain copy.
 auto IBMFFontMod::convertToOneBit(const Bitmap &bitmapHeightBits, BitmapPtr *bitmapOneBit) -> bool {
-  *bitmapOneBit        = BitmapPtr(new Bitmap);
-  (*bitmapOneBit)->dim = bitmapHeightBits.dim;
-  auto pix             = &(*bitmapOneBit)->pixels;
-  for (int row = 0, idx = 0; row < bitmapHeightBits.dim.height; row++) {
-    uint8_t data = 0;
-    uint8_t mask = 0x80;
-    for (int col = 0; col < bitmapHeightBits.dim.width; col++, idx++) {
-      data |= bitmapHeightBits.pixels[idx] == 0 ? 0 : mask;
-      mask >>= 1;
-      if (mask == 0) {
-        pix->push_back(data);
-        data = 0;
-        mask = 0x80;
+  *bitmapOneBit = BitmapPtr(new Bitmap(bitmapHeightBits));
+  return true;
+}
+
+// Optical kerning of glyph 2 following glyph 1: glyph 2 is moved to the left,
+// one pixel at a time, until it touches glyph 1, or one of the pixels just
+// above or below glyph 1 pixels. In each row, the first pixels to touch are
+// the leftmost one of glyph 2 and the rightmost one of glyph 1 (and its
+// neighbour rows): the distance is the smallest one between the profiles of
+// the glyphs. When the glyphs overlap in some row before being moved, they
+// are considered touching at once.
+
+auto IBMFFontMod::computeAutoKerning(const Bitmap &b1, const Bitmap &b2, const GlyphInfo &i1,
+                                     const GlyphInfo &i2) -> FIX16 {
+  GlyphProfile p1, p2;
+  computeGlyphProfile(b1, p1);
+  computeGlyphProfile(b2, p2);
+  return computeAutoKerning(p1, p2, i1, i2);
+}
+
+auto IBMFFontMod::computeAutoKerning(const GlyphProfile &p1, const GlyphProfile &p2,
+                                     const GlyphInfo &i1, const GlyphInfo &i2) -> FIX16 {
+  // Glyph 2 row 0 is at glyph 1 row rowOffset
+  int rowOffset = i1.verticalOffset - i2.verticalOffset;
+
+  int advance   = ((i1.advance + 32) >> 6);
+  if (advance == 0) advance = i1.bitmapWidth + 1;
+
+  // Glyph 2 column 0 is at glyph 1 column colOffset
+  int colOffset = advance + i1.horizontalOffset - i2.horizontalOffset;
+
+  // Rows of glyph 2 facing the right profile of glyph 1. The loop has no
+  // branch, for the compiler to vectorize it.
+  int            first    = std::max(0, -1 - rowOffset);
+  int            last     = std::min<int>(p2.left.size(), p1.right.size() - 1 - rowOffset);
+  const int16_t *left     = p2.left.data();
+  const int16_t *right    = p1.right.data();
+  int            shift    = rowOffset + 1;
+
+  int            distance = INT32_MAX / 2;
+  for (int row = first; row < last; row++) {
+    distance = std::min(distance, left[row] - right[row + shift]);
+  }
+  distance += colOffset;
+
+  // Glyph 2 is moved at most advance - 2 pixels
+  if (distance < 0) distance = 0;
+  if (distance > (advance - 2)) return 0;
+
+  return (AUTO_KERNING_SIZE + 1 - distance) << 6;
+}
+
+auto IBMFFontMod::computeGlyphProfile(const Bitmap &bitmap, GlyphProfile &profile) -> void {
+  int height = bitmap.dim.height;
+
+  profile.left.assign(height, GlyphProfile::NO_LEFT);
+  profile.right.assign(height + 2, GlyphProfile::NO_RIGHT);
+
+  for (int row = 0; row < height; row++) {
+    int index = 0;
+    while ((index < bitmap.wordsPerRow) && (bitmap.getWord(row, index) == 0)) index++;
+    if (index == bitmap.wordsPerRow) continue;
+
+    profile.left[row] = (index * Bitmap::WORD_BITS) +
+                        Bitmap::countLeadingZeros(bitmap.getWord(row, index));
+
+    index = bitmap.wordsPerRow - 1;
+    while (bitmap.getWord(row, index) == 0) index--;
+    int16_t right = (index * Bitmap::WORD_BITS) + Bitmap::WORD_BITS - 1 -
+                    __builtin_ctzll(bitmap.getWord(row, index));
+
+    // Glyph 1 row is also facing glyph 2 rows just above and below it
+    for (int i = row; i <= (row + 2); i++) {
+      profile.right[i] = std::max(profile.right[i], right);
+    }
+  }
+}
+
+// The profiles of the glyphs are computed first, then the pairs are kerned in
+// parallel, by ranges of first glyphs. The kerning steps are updated last by
+// applyAutoKerning(), in sequence, as the lig/kern steps of a face are shared
+// by all its glyphs.
+//
+// As the lig/kern table of a face is limited in size (and in number of
+// distinct pgms), the kernings kept are the ones above the smallest threshold
+// for which the table still fits. The threshold is chosen from the steps and
+// pgms counts of each threshold, then confirmed on a trial face.
+
+auto IBMFFontMod::generateAutoKerning(const std::vector<GlyphCode> &glyphCodes, FIX16 minKern)
+    -> AutoKerningStats {
+  return applyAutoKerning(prepareAutoKerning(glyphCodes, minKern));
+}
+
+auto IBMFFontMod::prepareAutoKerning(const std::vector<GlyphCode> &glyphCodes, FIX16 minKern,
+                                     AutoKerningProgress *progress) const -> AutoKerning {
+  AutoKerning       kerning;
+  AutoKerningStats &stats = kerning.stats;
+  stats = AutoKerningStats{.pairCount = 0, .kernStepCount = 0, .droppedKernStepCount = 0};
+  kerning.glyphLigKerns.resize(preamble_.faceCount);
+
+  if (progress != nullptr) {
+    uint64_t firstGlyphCount = 0;
+    for (int faceIndex = 0; faceIndex < preamble_.faceCount; faceIndex++) {
+      int glyphCount = faces_[faceIndex]->header->glyphCount;
+      for (auto glyphCode : glyphCodes) firstGlyphCount += (glyphCode < glyphCount) ? 1 : 0;
+    }
+    progress->firstGlyphCount     = firstGlyphCount;
+    progress->doneFirstGlyphCount = 0;
+  }
+  auto canceled = [progress]() -> bool { return (progress != nullptr) && progress->canceled; };
+
+  for (int faceIndex = 0; faceIndex < preamble_.faceCount; faceIndex++) {
+    const Face &face       = *faces_[faceIndex];
+    int         glyphCount = face.header->glyphCount;
+
+    std::vector<GlyphCode> codes;
+    for (auto glyphCode : glyphCodes) {
+      if (glyphCode < glyphCount) codes.push_back(glyphCode);
+    }
+    size_t count = codes.size();
+
+    std::vector<GlyphProfile> profiles(count);
+    parallelFor(0, count, GLYPH_GRAIN_SIZE, [&](size_t first, size_t last) {
+      for (size_t i = first; i < last; i++) {
+        BitmapPtr bitmap = face.bitmaps[codes[i]];
+        if (bitmap == nullptr) bitmap = retrieveBitmap(faceIndex, codes[i]);
+        computeGlyphProfile(*bitmap, profiles[i]);
+      }
+    });
+
+    // ligKern() matches the next glyph by its main code: composite and alias
+    // glyphs are kerned through their main glyph, never as second glyphs.
+    std::vector<uint8_t> isMain(count);
+    size_t               mainCount = 0;
+    for (size_t i = 0; i < count; i++) {
+      GlyphCode mainCode = face.glyphs[codes[i]].mainCode;
+      if (preamble_.bits.fontFormat == FontFormat::LATIN) mainCode &= LATIN_GLYPH_CODE_MASK;
+      isMain[i] = mainCode == codes[i];
+      mainCount += isMain[i];
+    }
+
+    std::vector<GlyphKernSteps> kernSteps(count);
+    parallelFor(0, count, KERN_GRAIN_SIZE, [&](size_t first, size_t last) {
+      for (size_t i = first; (i < last) && !canceled(); i++) {
+        const GlyphInfo &info = face.glyphs[codes[i]];
+        for (size_t j = 0; j < count; j++) {
+          if (!isMain[j]) continue;
+          FIX16 kern = computeAutoKerning(profiles[i], profiles[j], info, face.glyphs[codes[j]]);
+          if ((kern != 0) && (std::abs(kern) >= minKern)) {
+            kernSteps[i].push_back(GlyphKernStep{.nextGlyphCode = codes[j], .kern = kern});
+          }
+        }
+        if (progress != nullptr) progress->doneFirstGlyphCount++;
+      }
+    });
+    if (canceled()) return AutoKerning{};
+
+    stats.pairCount += static_cast<uint64_t>(count) * mainCount;
+
+    // The glyph lig/kern of a first glyph with the kernings of at least
+    // threshold, and the number of kerning steps written.
+    std::vector<GlyphLigKernPtr> glyphLigKerns(count);
+    std::vector<bool>            kerned(glyphCount, false);
+    auto merge = [&](size_t i, int threshold, GlyphLigKern &glyphLigKern) -> size_t {
+      glyphLigKern = *glyphLigKerns[i];
+      size_t first = glyphLigKern.kernSteps.size();
+      for (auto &step : kernSteps[i]) {
+        if (std::abs(step.kern) < threshold) continue;
+        kerned[step.nextGlyphCode] = true;
+        glyphLigKern.kernSteps.push_back(step);
+      }
+      size_t written = glyphLigKern.kernSteps.size() - first;
+      auto   end     = std::remove_if(
+          glyphLigKern.kernSteps.begin(), glyphLigKern.kernSteps.begin() + first,
+          [&](const GlyphKernStep &step) { return kerned[step.nextGlyphCode]; });
+      glyphLigKern.kernSteps.erase(end, glyphLigKern.kernSteps.begin() + first);
+      for (auto &step : kernSteps[i]) kerned[step.nextGlyphCode] = false;
+      return written;
+    };
+
+    std::vector<int> thresholds;
+    for (size_t i = 0; i < count; i++) {
+      glyphLigKerns[i] = face.getGlyphLigKern(codes[i]);
+      for (auto &step : kernSteps[i]) thresholds.push_back(std::abs(step.kern));
+    }
+    if (thresholds.empty()) continue;
+    std::sort(thresholds.begin(), thresholds.end());
+    thresholds.erase(std::unique(thresholds.begin(), thresholds.end()), thresholds.end());
+
+    std::vector<int> codeIndexes(glyphCount, -1);
+    for (size_t i = 0; i < count; i++) codeIndexes[codes[i]] = i;
+
+    auto fits = [&](int threshold) -> bool {
+      Face         trial;
+      GlyphLigKern glyphLigKern;
+      trial.header = face.header;
+      for (int glyphCode = 0; glyphCode < glyphCount; glyphCode++) {
+        if (codeIndexes[glyphCode] >= 0) {
+          merge(codeIndexes[glyphCode], threshold, glyphLigKern);
+          trial.addGlyphLigKern(glyphLigKern);
+        } else {
+          trial.addGlyphLigKern(*face.getGlyphLigKern(glyphCode));
+        }
+      }
+      return ligKernFits(trial);
+    };
+
+    // thresholds[level] being the smallest kerning kept, level thresholds.size()
+    // keeping none of them.
+    //
+    // The distinct pgms of the face and their steps are counted for each
+    // level, as pgms with the same steps are shared at save time. The content
+    // of a pgm is summarized by its number of steps and the sum of its steps
+    // hashes, such that the new steps of a glyph change it from the level of
+    // their kerning down. The lowest level whose counts are within the format
+    // limits is then checked by packing a trial face, higher levels being
+    // tried by bisection when it doesn't fit (a few long pgms may leave too
+    // many to relocate).
+    size_t levelCount = thresholds.size();
+
+    auto stepHash = [](uint64_t key) -> uint64_t {
+      key = (key ^ (key >> 30)) * 0xBF58476D1CE4E5B9ULL;
+      key = (key ^ (key >> 27)) * 0x94D049BB133111EBULL;
+      return key ^ (key >> 31);
+    };
+    auto ligHash = [&](const GlyphLigStep &step) -> uint64_t {
+      return stepHash((static_cast<uint64_t>(step.nextGlyphCode) << 16) |
+                      step.replacementGlyphCode);
+    };
+    auto kernHash = [&](const GlyphKernStep &step) -> uint64_t {
+      return stepHash((1ULL << 32) | (static_cast<uint64_t>(step.nextGlyphCode) << 16) |
+                      static_cast<uint16_t>(step.kern));
+    };
+    auto pgmKey = [&](uint64_t hash, int64_t stepCount) -> uint64_t {
+      return stepHash(hash + static_cast<uint64_t>(stepCount));
+    };
+
+    // Pgms of the glyphs not changed at any level
+
+    std::unordered_map<uint64_t, int64_t> unchangedPgms; // Steps count by pgm
+    for (int glyphCode = 0; glyphCode < glyphCount; glyphCode++) {
+      if ((codeIndexes[glyphCode] >= 0) && !kernSteps[codeIndexes[glyphCode]].empty()) continue;
+      if (static_cast<size_t>(glyphCode) >= face.ligKernRanges.size()) break;
+      const GlyphLigKernRange &range = face.ligKernRanges[glyphCode];
+      int64_t                  steps = range.ligStepCount + range.kernStepCount;
+      if (steps == 0) continue;
+      uint64_t hash = 0;
+      for (int k = 0; k < range.ligStepCount; k++) {
+        hash += ligHash(face.ligSteps[range.firstLigStep + k]);
+      }
+      for (int k = 0; k < range.kernStepCount; k++) {
+        hash += kernHash(face.kernSteps[range.firstKernStep + k]);
+      }
+      unchangedPgms.emplace(pgmKey(hash, steps), steps);
+    }
+    int64_t unchangedStepCount = 0;
+    for (auto &pgm : unchangedPgms) unchangedStepCount += pgm.second;
+
+    // Pgms of the glyphs getting new steps, for each level
+
+    typedef std::pair<uint64_t, int64_t> PgmEntry; // Key and steps count
+    std::vector<std::vector<PgmEntry>>   changedPgms(levelCount);
+    std::vector<int>                     currentSteps(glyphCount, -1);
+    std::vector<uint64_t>                levelHashes(levelCount);
+    std::vector<int64_t>                 levelStepCounts(levelCount);
+    for (size_t i = 0; i < count; i++) {
+      if (kernSteps[i].empty()) continue;
+      const GlyphLigKern &current = *glyphLigKerns[i];
+      uint64_t            hash    = 0;
+      for (auto &step : current.ligSteps) hash += ligHash(step);
+      for (size_t k = 0; k < current.kernSteps.size(); k++) {
+        hash += kernHash(current.kernSteps[k]);
+        currentSteps[current.kernSteps[k].nextGlyphCode] = k;
+      }
+      std::fill(levelHashes.begin(), levelHashes.end(), 0);
+      std::fill(levelStepCounts.begin(), levelStepCounts.end(), 0);
+      for (auto &step : kernSteps[i]) {
+        size_t level = std::lower_bound(thresholds.begin(), thresholds.end(),
+                                        std::abs(step.kern)) -
+                       thresholds.begin();
+        int replaced = currentSteps[step.nextGlyphCode];
+        levelHashes[level] += kernHash(step);
+        if (replaced >= 0) {
+          levelHashes[level] -= kernHash(current.kernSteps[replaced]);
+        } else {
+          levelStepCounts[level] += 1;
+        }
+      }
+      for (auto &step : current.kernSteps) currentSteps[step.nextGlyphCode] = -1;
+
+      int64_t steps = current.ligSteps.size() + current.kernSteps.size();
+      for (size_t level = levelCount; level > 0; level--) {
+        hash += levelHashes[level - 1];
+        steps += levelStepCounts[level - 1];
+        if (steps > 0) changedPgms[level - 1].emplace_back(pgmKey(hash, steps), steps);
+      }
+    }
+
+    // Lowest level within the limits
+
+    size_t level = 0;
+    for (; level < levelCount; level++) {
+      std::vector<PgmEntry> &pgms = changedPgms[level];
+      std::sort(pgms.begin(), pgms.end());
+      pgms.erase(std::unique(pgms.begin(), pgms.end()), pgms.end());
+      int64_t pgmCount  = unchangedPgms.size();
+      int64_t stepCount = unchangedStepCount;
+      for (auto &pgm : pgms) {
+        if (unchangedPgms.count(pgm.first) != 0) continue;
+        pgmCount += 1;
+        stepCount += pgm.second;
       }
+      if ((pgmCount <= 255) && ((stepCount + pgmCount) <= MAX_GOTO_DISPLACEMENT)) break;
+    }
+    if ((level < levelCount) && !fits(thresholds[level])) {
+      size_t low = level + 1, high = levelCount;
+      while (low < high) {
+        size_t middle = (low + high) / 2;
+        if (fits(thresholds[middle])) {
+          high = middle;
+        } else {
+          low = middle + 1;
+        }
+      }
+      level = low;
+    }
+    int threshold = (level < thresholds.size()) ? thresholds[level] : INT32_MAX;
+
+    GlyphLigKern glyphLigKern;
+    for (size_t i = 0; i < count; i++) {
+      if (kernSteps[i].empty()) continue;
+      size_t written = merge(i, threshold, glyphLigKern);
+      if (written > 0) kerning.glyphLigKerns[faceIndex].emplace_back(codes[i], glyphLigKern);
+      stats.kernStepCount += written;
+      stats.droppedKernStepCount += kernSteps[i].size() - written;
+    }
+  }
+
+  return kerning;
+}
+
+auto IBMFFontMod::applyAutoKerning(const AutoKerning &kerning) -> AutoKerningStats {
+  for (size_t faceIndex = 0; faceIndex < kerning.glyphLigKerns.size(); faceIndex++) {
+    if (faceIndex >= faces_.size()) break;
+    for (auto &entry : kerning.glyphLigKerns[faceIndex]) {
+      faces_[faceIndex]->setGlyphLigKern(entry.first, entry.second);
     }
-    if (mask != 0) pix->push_back(data);
   }
-  return pix->size() == (bitmapHeightBits.dim.height * ((bitmapHeightBits.dim.width + 7) >> 3));
+  return kerning.stats;
 }
 
 // In the process of optimizing the size of the ligKern table, this method
 // search to find if a part of the already prepared list contains the same
 // steps as per the pgm received as a parameter. If so, the index of the
 // similar list of steps is returned, else -1
-auto IBMFFontMod::findList(std::vector<LigKernStepPtr> &pgm,
-                           std::vector<LigKernStepPtr> &list) const -> int {
-
-  auto pred = [](const LigKernStepPtr &e1, const LigKernStepPtr &e2) -> bool {
-    return (e1->a.whole.val == e2->a.whole.val) && (e1->b.whole.val == e2->b.whole.val);
+//
+// As only the last step of a pgm has its stop flag set, a pgm can only be
+// found in the list as the end of a pgm added before it. The ends of all the
+// pgms in the list are indexed by their hash (see addListSuffixes()), with the
+// first location of each hash. On the unlikely hash collision, the list is
+// searched the long way.
+auto IBMFFontMod::findList(const std::vector<LigKernStep> &pgm,
+                           const std::vector<LigKernStep> &list,
+                           const LigKernSuffixes          &suffixes) const -> int {
+
+  auto pred = [](const LigKernStep &e1, const LigKernStep &e2) -> bool {
+    return (e1.a.whole.val == e2.a.whole.val) && (e1.b.whole.val == e2.b.whole.val);
   };
 
+  auto entry = suffixes.find(hashLigKernSteps(pgm.data(), pgm.data() + pgm.size()));
+  if (entry == suffixes.end()) return -1;
+
+  int start = entry->second;
+  if (((start + pgm.size()) <= list.size()) &&
+      std::equal(pgm.begin(), pgm.end(), list.begin() + start, pred)) {
+    return start;
+  }
+
   auto it = std::search(list.begin(), list.end(), pgm.begin(), pgm.end(), pred);
   return (it == list.end()) ? -1 : std::distance(list.begin(), it);
 }
 
+// The hash of a sequence of lig/kern steps is computed from the last step to
+// the first one, such that the hashes of all the ends of a pgm are retrieved
+// in a single pass.
+auto IBMFFontMod::hashLigKernStep(uint64_t hash, const LigKernStep &step) -> uint64_t {
+  return (hash * 0x9E3779B97F4A7C15ULL) + ((static_cast<uint64_t>(step.a.whole.val) << 16) |
+                                           step.b.whole.val) +
+         1;
+}
+
+auto IBMFFontMod::hashLigKernSteps(const LigKernStep *first, const LigKernStep *last)
+    -> uint64_t {
+  uint64_t hash = 0;
+  while (last != first) hash = hashLigKernStep(hash, *--last);
+  return hash;
+}
+
+// Index all the ends of the pgm starting at index first, the last one in the
+// list.
+auto IBMFFontMod::addListSuffixes(const std::vector<LigKernStep> &list, int first,
+                                  LigKernSuffixes &suffixes) -> void {
+  uint64_t hash = 0;
+  for (int idx = static_cast<int>(list.size()) - 1; idx >= first; idx--) {
+    hash = hashLigKernStep(hash, list[idx]);
+    suffixes.emplace(hash, idx); // The first location is kept
+  }
+}
+
+// The lig/kern pgm of a glyph, as a sequence of steps ending with the stop
+// flag. Empty if the glyph has no ligature or kerning.
+auto IBMFFontMod::buildLigKernPgm(const Face &face, int glyphCode, std::vector<LigKernStep> &pgm)
+    -> void {
+  const GlyphLigKernRange &range = face.ligKernRanges[glyphCode];
+  const GlyphLigStep      *lStep = face.ligSteps.data() + range.firstLigStep;
+  const GlyphKernStep     *kStep = face.kernSteps.data() + range.firstKernStep;
+
+  pgm.clear();
+  pgm.reserve(range.ligStepCount + range.kernStepCount);
+
+  // clang-format off
+  for (int i = 0; i < range.ligStepCount; i++, lStep++) {
+    pgm.push_back(LigKernStep({
+      .a = {.data = {.nextGlyphCode = lStep->nextGlyphCode, .stop = false}},
+      .b = {.repl = {.replGlyphCode = lStep->replacementGlyphCode, .isAKern = false}}
+    }));
+  }
+
+  for (int i = 0; i < range.kernStepCount; i++, kStep++) {
+    pgm.push_back(LigKernStep({
+      .a = { .data = {.nextGlyphCode = kStep->nextGlyphCode, .stop = false}},
+      .b = {.kern = {.kerningValue = (FIX14)kStep->kern, .isAGoTo = false, .isAKern = true}}
+    }));
+  }
+  // clang-format on
+
+  if (!pgm.empty()) pgm.back().a.data.stop = true;
+}
+
+// ----- Retrieves all ligature and kerning in a single list -----
+//
+// glyphsPgmIndexes receives the starting index of each glyph's pgm.
+// uniquePgmIndexes receive the non-duplicate indexes
+// lkSteps receives the integrated list.
+//
+// The glyphs pgms are added in glyph order. Optimization is done to reuse
+// part of pgms that are the same for a glyph vs the other ones.
+auto IBMFFontMod::packLigKernPgms(const Face &face, std::vector<LigKernStep> &lkSteps,
+                                  std::vector<int> &glyphsPgmIndexes,
+                                  std::set<int>    &uniquePgmIndexes) const -> void {
+  std::vector<LigKernStep> glyphPgm;
+  LigKernSuffixes          suffixes; // Index of the pgms ends in lkSteps
+
+  for (int glyphIdx = 0; glyphIdx < face.header->glyphCount; glyphIdx++) {
+    buildLigKernPgm(face, glyphIdx, glyphPgm);
+
+    if (glyphPgm.size() == 0) {
+      glyphsPgmIndexes[glyphIdx] = -1; // empty list
+    } else {
+      int sameIdx; // Idx of the equivalent pgm if found (-1 otherwise)
+      //           Must start at 2 as cannot have a sameIdx equal to 0 or 1:
+      //           Cannot negate 0, and -1 is reserved for a null pgm in
+      //           glyphsPgmIndexes
+      if ((sameIdx = findList(glyphPgm, lkSteps, suffixes)) > 1) {
+        // We found a duplicated list. Remove the duplicate one and make it
+        // point to the first found to be similar.
+        glyphsPgmIndexes[glyphIdx] = -sameIdx; // negative to signify a duplicate list
+        uniquePgmIndexes.insert(sameIdx);
+      } else {
+        int index = lkSteps.size();
+        uniquePgmIndexes.insert(index);
+        glyphsPgmIndexes[glyphIdx] = index;
+        std::move(glyphPgm.begin(), glyphPgm.end(), std::back_inserter(lkSteps));
+        addListSuffixes(lkSteps, index, suffixes);
+      }
+    }
+  }
+}
+
+// Same as packLigKernPgms(), with the pgms reordered to reduce the size of
+// the list:
+//
+// - As only the last step of a pgm has its stop flag set, two pgms can only
+// overlap when one is the end of the other. Starting with the longest pgms,
+// a pgm that is the end of a pgm already kept is located inside it, else it is
+// kept as a block of the list. This is the greedy shortest common superstring
+// of the pgms, ending with stop.
+//
+// - The blocks with the most pgm starting points per step, then the most
+// referenced ones, are put first. This keeps as many starting points as
+// possible below index 255, where no goto step is required to reach them.
+auto IBMFFontMod::optimizeLigKernPgms(const Face &face, std::vector<LigKernStep> &lkSteps,
+                                      std::vector<int> &glyphsPgmIndexes,
+                                      std::set<int>    &uniquePgmIndexes) const -> void {
+  struct Pgm {
+    std::vector<LigKernStep> steps;
+    int                      glyphCount; // Glyphs using the pgm
+    int                      block;      // Pgm kept as the block containing this one
+    int                      offset;     // Location in the block
+  };
+
+  struct Block {
+    int pgm;
+    int startCount; // Distinct pgm starting points in the block
+    int glyphCount; // Glyphs using the pgms of the block
+    int index;      // Location in the list
+  };
+
+  auto pred = [](const LigKernStep &e1, const LigKernStep &e2) -> bool {
+    return (e1.a.whole.val == e2.a.whole.val) && (e1.b.whole.val == e2.b.whole.val);
+  };
+
+  // Distinct pgms, with the glyphs using them
+
+  std::vector<Pgm>                  pgms;
+  std::vector<int>                  glyphsPgm(face.header->glyphCount, -1);
+  std::unordered_map<uint64_t, int> pgmIndex;
+  std::vector<LigKernStep>          glyphPgm;
+
+  for (int glyphIdx = 0; glyphIdx < face.header->glyphCount; glyphIdx++) {
+    buildLigKernPgm(face, glyphIdx, glyphPgm);
+    if (glyphPgm.empty()) continue;
+
+    uint64_t hash  = hashLigKernSteps(glyphPgm.data(), glyphPgm.data() + glyphPgm.size());
+    auto     entry = pgmIndex.find(hash);
+    if ((entry != pgmIndex.end()) &&
+        std::equal(glyphPgm.begin(), glyphPgm.end(), pgms[entry->second].steps.begin(),
+                   pgms[entry->second].steps.end(), pred)) {
+      glyphsPgm[glyphIdx] = entry->second;
+      pgms[entry->second].glyphCount += 1;
+    } else {
+      glyphsPgm[glyphIdx] = pgms.size();
+      pgmIndex.emplace(hash, pgms.size());
+      pgms.push_back(Pgm{.steps = glyphPgm, .glyphCount = 1, .block = -1, .offset = 0});
+    }
+  }
+
+  // Blocks, from the longest pgms. The ends of the blocks are indexed by
+  // hash, as for findList().
+
+  std::vector<int> order(pgms.size());
+  for (size_t i = 0; i < order.size(); i++) order[i] = i;
+  std::stable_sort(order.begin(), order.end(),
+                   [&pgms](int i, int j) { return pgms[i].steps.size() > pgms[j].steps.size(); });
+
+  std::vector<Block>                               blocks;
+  std::unordered_map<uint64_t, std::pair<int, int>> blockEnds; // Block and offset
+  std::vector<std::set<int>>                       blockStarts;
+
+  for (int pgmIdx : order) {
+    Pgm     &pgm   = pgms[pgmIdx];
+    uint64_t hash  = hashLigKernSteps(pgm.steps.data(), pgm.steps.data() + pgm.steps.size());
+    auto     entry = blockEnds.find(hash);
+    if (entry != blockEnds.end()) {
+      const Pgm &blockPgm = pgms[blocks[entry->second.first].pgm];
+      if (std::equal(pgm.steps.begin(), pgm.steps.end(),
+                     blockPgm.steps.begin() + entry->second.second, blockPgm.steps.end(), pred)) {
+        pgm.block  = entry->second.first;
+        pgm.offset = entry->second.second;
+      }
+    }
+    if (pgm.block == -1) {
+      pgm.block = blocks.size();
+      blocks.push_back(Block{.pgm = pgmIdx, .startCount = 0, .glyphCount = 0, .index = 0});
+      blockStarts.emplace_back();
+      hash = 0;
+      for (int offset = pgm.steps.size() - 1; offset > 0; offset--) {
+        hash = hashLigKernStep(hash, pgm.steps[offset]);
+        blockEnds.emplace(hash, std::make_pair(pgm.block, offset));
+      }
+    }
+    blockStarts[pgm.block].insert(pgm.offset);
+    blocks[pgm.block].glyphCount += pgm.glyphCount;
+  }
+
+  for (size_t i = 0; i < blocks.size(); i++) blocks[i].startCount = blockStarts[i].size();
+
+  // Blocks layout
+
+  std::vector<int> blockOrder(blocks.size());
+  for (size_t i = 0; i < blockOrder.size(); i++) blockOrder[i] = i;
+  std::stable_sort(blockOrder.begin(), blockOrder.end(), [&](int i, int j) {
+    int64_t lengthI = pgms[blocks[i].pgm].steps.size();
+    int64_t lengthJ = pgms[blocks[j].pgm].steps.size();
+    if ((blocks[i].startCount * lengthJ) != (blocks[j].startCount * lengthI)) {
+      return (blocks[i].startCount * lengthJ) > (blocks[j].startCount * lengthI);
+    }
+    return (blocks[i].glyphCount * lengthJ) > (blocks[j].glyphCount * lengthI);
+  });
+
+  for (int blockIdx : blockOrder) {
+    const Pgm &pgm        = pgms[blocks[blockIdx].pgm];
+    blocks[blockIdx].index = lkSteps.size();
+    lkSteps.insert(lkSteps.end(), pgm.steps.begin(), pgm.steps.end());
+  }
+
+  for (int glyphIdx = 0; glyphIdx < face.header->glyphCount; glyphIdx++) {
+    if (glyphsPgm[glyphIdx] == -1) {
+      glyphsPgmIndexes[glyphIdx] = -1; // empty list
+    } else {
+      const Pgm &pgm             = pgms[glyphsPgm[glyphIdx]];
+      int        index           = blocks[pgm.block].index + pgm.offset;
+      glyphsPgmIndexes[glyphIdx] = index;
+      uniquePgmIndexes.insert(index);
+    }
+  }
+}
+
+// Compute how many entries we need to add to the lig/kern vector to redirect
+// over the limiting 255 indexes, and where to add them. The pgms starting at
+// the location of the goto entries or after it are relocated. The goto
+// entries must be added at the start of a pgm block, not in the middle of a
+// pgm that is shared with other glyphs.
+auto IBMFFontMod::findLigKernOverflows(const std::vector<LigKernStep> &lkSteps,
+                                       const std::set<int>            &uniquePgmIndexes,
+                                       std::set<int> &overflowList, int &newLigKernIdx) -> int {
+  int spaceRequired = 0;
+  newLigKernIdx     = 0;
+  for (auto idx = uniquePgmIndexes.rbegin(); idx != uniquePgmIndexes.rend(); idx++) {
+    bool belowLimit = (*idx + spaceRequired) < 255;
+    if (belowLimit && (spaceRequired == 0)) break;
+    overflowList.insert(*idx);
+    spaceRequired += 1;
+    newLigKernIdx = *idx;
+    if (belowLimit && ((*idx == 0) || lkSteps[*idx - 1].a.data.stop)) break;
+  }
+  return spaceRequired;
+}
+
+// The lig/kern steps of a face, with the goTos relocating the pgms starting
+// beyond 254, must fit in the face header count. The relocated pgms must stay
+// reachable through the 14 bits displacement of the goTos, and the goTos
+// through the 8 bits pgm index of the glyphs.
+auto IBMFFontMod::ligKernTooLarge(size_t stepCount, const std::set<int> &overflowList,
+                                  int spaceRequired, int newLigKernIdx) -> bool {
+  if ((stepCount + overflowList.size()) > MAX_LIG_KERN_STEP_COUNT) return true;
+  if (overflowList.empty()) return false;
+  return ((*overflowList.rbegin() + spaceRequired) > MAX_GOTO_DISPLACEMENT) ||
+         ((newLigKernIdx + overflowList.size()) > 255);
+}
+
+// Whether the lig/kern steps of the face can be saved, as packed in glyph
+// order by prepareLigKernVectors().
+auto IBMFFontMod::ligKernFits(const Face &face) const -> bool {
+  std::vector<LigKernStep> lkSteps;
+  std::vector<int>         glyphsPgmIndexes(face.header->glyphCount, -1);
+  std::set<int>            uniquePgmIndexes;
+  std::set<int>            overflowList;
+  int                      newLigKernIdx;
+
+  packLigKernPgms(face, lkSteps, glyphsPgmIndexes, uniquePgmIndexes);
+  int spaceRequired = findLigKernOverflows(lkSteps, uniquePgmIndexes, overflowList, newLigKernIdx);
+  return !ligKernTooLarge(lkSteps.size(), overflowList, spaceRequired, newLigKernIdx);
+}
+
 // For all faces:
 //
 // - Retrieves all ligature and kerning for each face glyphs, setting the
 // index in the integrated vector, optimizing the glyphs' list to reuse the
-// ones that are similar
+// ones that are similar. When the lig/kern packing optimization is enabled,
+// the pgms are also reordered, and the smallest of the two lists retained.
 //
 // - If there is some series with index beyond 254, create goto entries. All
 // starting indexes must be before 255
 auto IBMFFontMod::prepareLigKernVectors() -> bool {
+  ligKernStepsSaved_ = 0;
+
   for (auto &face : faces_) {
+    if (!face->ligKernModified) continue; // The current steps are still valid
 
     auto &lkSteps = face->ligKernSteps;
 
@@ -482,178 +1432,105 @@ auto IBMFFontMod::prepareLigKernVectors() -> bool {
     // Working list for glyphs pgm vector reconstruction
     // = -1 if a glyph's Lig/Kern pgm is empty
     // < -1 if it has been relocated
-    std::vector<int>            glyphsPgmIndexes(face->header->glyphCount, -1);
-    std::vector<LigKernStepPtr> glyphPgm;
-
-    // ----- Retrieves all ligature and kerning in a single list -----
-    //
-    // glyphsPgmIndexes receives the starting index of each glyph's pgm.
-    // uniquePgmIndexes receive the non-duplicate indexes
-    // face's ligKernSteps receives the integrated list.
-    //
-    // Optimization is done to reuse part of pgms that are the same for
-    // a glyph vs the other ones
-
-    int glyphIdx = 0;
-    for (int glyphIdx = 0; glyphIdx < face->header->glyphCount; glyphIdx++) {
-      //      for (int glyphIdx = face->header->glyphCount - 1; glyphIdx >= 0;
-      //      glyphIdx--) {
-
-      LigKernStepPtr lks = nullptr;
-
-      auto lSteps        = face->glyphsLigKern[glyphIdx]->ligSteps;
-      auto kSteps        = face->glyphsLigKern[glyphIdx]->kernSteps;
-
-      glyphPgm.clear();
-      glyphPgm.reserve(lSteps.size() + kSteps.size());
-
-      // clang-format off
-        for (auto &lStep : lSteps) {
-          lks = LigKernStepPtr(new LigKernStep({
-            .a = {.data = {.nextGlyphCode = lStep->nextGlyphCode, .stop = false}},
-            .b = {.repl = {.replGlyphCode = lStep->replacementGlyphCode, .isAKern = false}}
-          }));
-          glyphPgm.push_back(lks);
-        }
-
-        for (auto &kStep : kSteps) {
-          lks = LigKernStepPtr(new LigKernStep({
-            .a = { .data = {.nextGlyphCode = kStep->nextGlyphCode, .stop = false}},
-            .b = {.kern = {.kerningValue = (FIX14)kStep->kern, .isAGoTo = false, .isAKern = true}}
-          }));
-          glyphPgm.push_back(lks);
-        }
-      // clang-format on
-
-      if (glyphPgm.size() == 0) {
-        glyphsPgmIndexes[glyphIdx] = -1; // empty list
-      } else if (lks != nullptr) {
-        lks->a.data.stop = true;
-        int sameIdx; // Idx of the equivalent pgm if found (-1 otherwise)
-        //           Must start at 2 as cannot have a sameIdx equal to 0 or 1:
-        //           Cannot negate 0, and -1 is reserved for a null pgm in
-        //           glyphsPgmIndexes
-        if ((sameIdx = findList(glyphPgm, lkSteps)) > 1) {
-          // We found a duplicated list. Remove the duplicate one and make it
-          // point to the first found to be similar.
-          glyphPgm.clear();
-          glyphsPgmIndexes[glyphIdx] = -sameIdx; // negative to signify a duplicate list
-          uniquePgmIndexes.insert(sameIdx);
-        } else {
-          int index = lkSteps.size();
-          uniquePgmIndexes.insert(index);
-          glyphsPgmIndexes[glyphIdx] = index;
-          std::move(glyphPgm.begin(), glyphPgm.end(), std::back_inserter(lkSteps));
-        }
-      } else {
-        QMessageBox::warning(nullptr, "Logic error",
-                             "There is a logic error in the prepareLigKernVectors() method -> "
-                             "lks not expected to be null!!");
-        return false;
+    std::vector<int> glyphsPgmIndexes(face->header->glyphCount, -1);
+
+    packLigKernPgms(*face, lkSteps, glyphsPgmIndexes, uniquePgmIndexes);
+
+    int newLigKernIdx;
+    int spaceRequired =
+        findLigKernOverflows(lkSteps, uniquePgmIndexes, overflowList, newLigKernIdx);
+
+    if (optimizeLigKern_) {
+      std::vector<LigKernStep> optimizedSteps;
+      std::vector<int>         optimizedIndexes(face->header->glyphCount, -1);
+      std::set<int>            optimizedUniqueIndexes;
+      std::set<int>            optimizedOverflowList;
+      int                      optimizedLigKernIdx;
+
+      optimizeLigKernPgms(*face, optimizedSteps, optimizedIndexes, optimizedUniqueIndexes);
+      int optimizedSpace = findLigKernOverflows(optimizedSteps, optimizedUniqueIndexes,
+                                                optimizedOverflowList, optimizedLigKernIdx);
+
+      int saved = (lkSteps.size() + spaceRequired) - (optimizedSteps.size() + optimizedSpace);
+      if ((saved > 0) && !ligKernTooLarge(optimizedSteps.size(), optimizedOverflowList,
+                                          optimizedSpace, optimizedLigKernIdx)) {
+        lkSteps.swap(optimizedSteps);
+        glyphsPgmIndexes.swap(optimizedIndexes);
+        uniquePgmIndexes.swap(optimizedUniqueIndexes);
+        overflowList.swap(optimizedOverflowList);
+        spaceRequired      = optimizedSpace;
+        newLigKernIdx      = optimizedLigKernIdx;
+        ligKernStepsSaved_ += saved;
       }
     }
 
     // ----- Relocate entries that overflowed beyond 254 -----
 
-    // Put them in a vector such that we can access them through indices.
+    // Glyphs using each one of the relocated pgms, both duplicated and
+    // non-duplicated indexes. -1 is an empty pgm, not the one at index 1.
 
-    // Compute how many entries we need to add to the lig/kern vector to
-    // redirect over the limiting 255 indexes, and where to add them.
+    std::map<int, std::vector<int>> overflowGlyphs;
+    for (int glyphIdx = 0; glyphIdx < static_cast<int>(glyphsPgmIndexes.size()); glyphIdx++) {
+      if (glyphsPgmIndexes[glyphIdx] == -1) continue;
+      int idx = abs(glyphsPgmIndexes[glyphIdx]);
+      if (overflowList.count(idx) != 0) overflowGlyphs[idx].push_back(glyphIdx);
+    }
 
-    int spaceRequired = 0;
-    int newLigKernIdx = 0;
-    for (auto idx = uniquePgmIndexes.rbegin(); idx != uniquePgmIndexes.rend(); idx++) {
-      if ((*idx + spaceRequired) >= 255) {
-        overflowList.insert(*idx);
-        spaceRequired += 1;
-      } else {
-        if (spaceRequired > 0) {
-          overflowList.insert(*idx);
-          spaceRequired += 1;
-          newLigKernIdx = *idx;
-        }
-        break;
-      }
+    std::vector<LigKernStep> goTos;
+    goTos.reserve(overflowList.size());
+    int firstGoToIdx = newLigKernIdx;
+
+    if (ligKernTooLarge(lkSteps.size(), overflowList, spaceRequired, newLigKernIdx)) {
+      return setError(9, "Too many lig/kern steps in a face");
     }
 
     for (auto idx = overflowList.rbegin(); idx != overflowList.rend(); idx++) {
       // std::cout << *idx << " treatment: " << std::endl;
-      LigKernStepPtr ligKernStep = LigKernStepPtr(new LigKernStep);
-      memset(ligKernStep.get(), 0, sizeof(LigKernStep));
-      ligKernStep->b.goTo.isAKern      = true;
-      ligKernStep->b.goTo.isAGoTo      = true;
-      ligKernStep->b.goTo.displacement = (*idx + spaceRequired);
+      LigKernStep ligKernStep;
+      memset(&ligKernStep, 0, sizeof(LigKernStep));
+      ligKernStep.b.goTo.isAKern      = true;
+      ligKernStep.b.goTo.isAGoTo      = true;
+      ligKernStep.b.goTo.displacement = (*idx + spaceRequired);
 
       // std::cout << "Added goto at location " << *idx << " to point at location "
       //           << (*idx + spaceRequired) << std::endl;
 
-      lkSteps.insert(lkSteps.begin() + newLigKernIdx, ligKernStep);
-      int gCode = 0;
-      for (auto pgmIdx = glyphsPgmIndexes.begin(); pgmIdx != glyphsPgmIndexes.end(); pgmIdx++) {
-        if (abs(*pgmIdx) == *idx) { // Must look at both duplicated and
-                                    // non-duplicated indexes
-          // std::cout << "Entry " << gCode << " pointing at " << *pgmIdx << " redirected to "
-          //           << (-5000 - newLigKernIdx) << std::endl;
-          *pgmIdx = -5000 - newLigKernIdx;
-        }
-        gCode++;
+      goTos.push_back(ligKernStep);
+      for (int glyphIdx : overflowGlyphs[*idx]) {
+        glyphsPgmIndexes[glyphIdx] = -5000 - newLigKernIdx;
       }
       newLigKernIdx++;
     } // for
 
-    glyphIdx = 0;
+    lkSteps.insert(lkSteps.begin() + firstGoToIdx, goTos.begin(), goTos.end());
+
+    int glyphIdx = 0;
     for (auto &glyph : face->glyphs) {
       if (glyphsPgmIndexes[glyphIdx] == -1) {
-        glyph->ligKernPgmIndex = 255;
+        glyph.ligKernPgmIndex = 255;
       } else {
         if ((abs(glyphsPgmIndexes[glyphIdx]) >= 255) && (abs(glyphsPgmIndexes[glyphIdx]) < 5000)) {
-          QMessageBox::warning(nullptr, "Logic Error",
-                               "A logic error was encoutered in method "
-                               "prepareLigKernVectors() "
-                               "-> computed LigKern PGM index >= 255!!");
-          return false;
+          return setError(7, "A logic error was encoutered in method "
+                             "prepareLigKernVectors() "
+                             "-> computed LigKern PGM index >= 255!!");
         }
         if (abs(glyphsPgmIndexes[glyphIdx]) >= 5000) {
-          glyph->ligKernPgmIndex = abs(glyphsPgmIndexes[glyphIdx]) - 5000;
+          glyph.ligKernPgmIndex = abs(glyphsPgmIndexes[glyphIdx]) - 5000;
         } else {
-          glyph->ligKernPgmIndex = abs(glyphsPgmIndexes[glyphIdx]);
+          glyph.ligKernPgmIndex = abs(glyphsPgmIndexes[glyphIdx]);
         }
       }
       glyphIdx += 1;
     }
+
+    face->ligKernModified = false;
   } // for each face
 
   return true;
 }
 
 auto IBMFFontMod::toGlyphCode(char32_t codePoint) const -> GlyphCode {
-
-  GlyphCode glyphCode = NO_GLYPH_CODE;
-
-  uint16_t planeIdx   = static_cast<uint16_t>(codePoint >> 16);
-
-  if (planeIdx <= 3) {
-    char16_t u16                = static_cast<char16_t>(codePoint);
-
-    uint16_t codePointBundleIdx = planes_[planeIdx].codePointBundlesIdx;
-    uint16_t entriesCount       = planes_[planeIdx].entriesCount;
-    int      gCode              = planes_[planeIdx].firstGlyphCode;
-    int      i                  = 0;
-    while (i < entriesCount) {
-      if (u16 <= codePointBundles_[codePointBundleIdx].lastCodePoint) {
-        break;
-      }
-      gCode += (codePointBundles_[codePointBundleIdx].lastCodePoint -
-                codePointBundles_[codePointBundleIdx].firstCodePoint + 1);
-      i++;
-      codePointBundleIdx++;
-    }
-    if ((i < entriesCount) && (u16 >= codePointBundles_[codePointBundleIdx].firstCodePoint)) {
-      glyphCode = gCode + u16 - codePointBundles_[codePointBundleIdx].firstCodePoint;
-    }
-  }
-
-  return glyphCode;
+  return codePointTable_.find(codePoint);
 }
 
 /**
@@ -766,63 +1643,100 @@ auto IBMFFontMod::translate(char32_t codePoint) const -> GlyphCode {
       }
     }
   } else if (preamble_.bits.fontFormat == FontFormat::UTF32) {
-    uint16_t planeIdx = static_cast<uint16_t>(codePoint >> 16);
+    GlyphCode code = codePointTable_.find(codePoint);
+    if (code != NO_GLYPH_CODE) glyphCode = code;
+  }
 
-    if (planeIdx <= 3) {
-      char16_t u16                = static_cast<char16_t>(codePoint);
+  return glyphCode;
+}
 
-      uint16_t codePointBundleIdx = planes_[planeIdx].codePointBundlesIdx;
-      uint16_t entriesCount       = planes_[planeIdx].entriesCount;
-      int      gCode              = planes_[planeIdx].firstGlyphCode;
-      int      i                  = 0;
-      while (i < entriesCount) {
-        if (u16 <= codePointBundles_[codePointBundleIdx].lastCodePoint) {
-          break;
-        }
-        gCode += (codePointBundles_[codePointBundleIdx].lastCodePoint -
-                  codePointBundles_[codePointBundleIdx].firstCodePoint + 1);
-        i++;
-        codePointBundleIdx++;
-      }
-      if ((i < entriesCount) && (u16 >= codePointBundles_[codePointBundleIdx].firstCodePoint)) {
-        glyphCode = gCode + u16 - codePointBundles_[codePointBundleIdx].firstCodePoint;
-      }
+// Same as above for a whole sequence of code points. The glyphCodes vector is
+// resized to the number of code points.
+auto IBMFFontMod::translate(const std::vector<char32_t> &codePoints,
+                            std::vector<GlyphCode>      &glyphCodes) const -> void {
+  glyphCodes.resize(codePoints.size());
+
+  if (preamble_.bits.fontFormat == FontFormat::UTF32) {
+    codePointTable_.find(codePoints.data(), codePoints.size(), glyphCodes.data());
+    for (auto &glyphCode : glyphCodes) {
+      if (glyphCode == NO_GLYPH_CODE) glyphCode = SPACE_CODE;
     }
+  } else {
+    for (size_t i = 0; i < codePoints.size(); i++) glyphCodes[i] = translate(codePoints[i]);
   }
+}
 
-  return glyphCode;
+auto IBMFFontMod::decodeUTF8(const char *text, size_t size, std::vector<char32_t> &codePoints)
+    -> void {
+  const uint8_t *str = reinterpret_cast<const uint8_t *>(text);
+
+  codePoints.clear();
+  codePoints.reserve(size);
+
+  size_t i = 0;
+  while (i < size) {
+    uint8_t ch = str[i++];
+    if (ch < 0x80) {
+      codePoints.push_back(ch);
+      continue;
+    }
+
+    int      count;
+    char32_t codePoint;
+    char32_t min;
+    if ((ch & 0xE0) == 0xC0) {
+      count     = 1;
+      codePoint = ch & 0x1F;
+      min       = 0x80;
+    } else if ((ch & 0xF0) == 0xE0) {
+      count     = 2;
+      codePoint = ch & 0x0F;
+      min       = 0x800;
+    } else if ((ch & 0xF8) == 0xF0) {
+      count     = 3;
+      codePoint = ch & 0x07;
+      min       = 0x10000;
+    } else {
+      codePoints.push_back(0xFFFD);
+      continue;
+    }
+
+    while ((count > 0) && (i < size) && ((str[i] & 0xC0) == 0x80)) {
+      codePoint = (codePoint << 6) | (str[i++] & 0x3F);
+      count -= 1;
+    }
+
+    if ((count > 0) || (codePoint < min) || (codePoint > 0x10FFFF) ||
+        ((codePoint >= 0xD800) && (codePoint <= 0xDFFF))) {
+      codePoint = 0xFFFD;
+    }
+    codePoints.push_back(codePoint);
+  }
+}
+
+auto IBMFFontMod::decodeUTF16(const char16_t *text, size_t size,
+                              std::vector<char32_t> &codePoints) -> void {
+  codePoints.clear();
+  codePoints.reserve(size);
+
+  size_t i = 0;
+  while (i < size) {
+    char32_t ch = text[i++];
+    if ((ch >= 0xD800) && (ch <= 0xDBFF) && (i < size) && (text[i] >= 0xDC00) &&
+        (text[i] <= 0xDFFF)) {
+      ch = 0x10000 + ((ch - 0xD800) << 10) + (text[i++] - 0xDC00);
+    } else if ((ch >= 0xD800) && (ch <= 0xDFFF)) {
+      ch = 0xFFFD;
+    }
+    codePoints.push_back(ch);
+  }
 }
 
 // Returns the corresponding UTF32 character for the glyphCode.
 auto IBMFFontMod::getUTF32(GlyphCode glyphCode) const -> char32_t {
   char32_t codePoint = 0;
   if (preamble_.bits.fontFormat == FontFormat::UTF32) {
-    int i = 0;
-    while (i < 3) {
-      if (planes_[i + 1].firstGlyphCode > glyphCode) break;
-      i += 1;
-    }
-    if (i < 4) {
-      int planeMask    = i << 16;
-      int bundleIdx    = planes_[i].codePointBundlesIdx;
-      int idx          = planes_[i].firstGlyphCode;
-      int entriesCount = planes_[i].entriesCount;
-      int j            = 0;
-      int bundleSize   = codePointBundles_[bundleIdx].lastCodePoint -
-                       codePointBundles_[bundleIdx].firstCodePoint + 1;
-
-      while (j < entriesCount) {
-        if ((idx + bundleSize) > glyphCode) break;
-        idx += bundleSize;
-        bundleIdx += 1;
-        bundleSize = codePointBundles_[bundleIdx].lastCodePoint -
-                     codePointBundles_[bundleIdx].firstCodePoint + 1;
-        j += 1;
-      }
-      if (j < entriesCount) {
-        codePoint = (codePointBundles_[bundleIdx].firstCodePoint + (glyphCode - idx)) | planeMask;
-      }
-    }
+    codePoint = codePointTable_.codePoint(glyphCode);
   } else {
     if (glyphCode < fontFormat0CodePoints.size()) {
       codePoint = fontFormat0CodePoints[glyphCode];
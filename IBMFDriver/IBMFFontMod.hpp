@@ -2,17 +2,23 @@
 
 #include <cstdlib>
 #include <cstring>
+#include <atomic>
 #include <iostream>
+#include <map>
+#include <mutex>
 #include <set>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "IBMFDefs.hpp"
 
 using namespace IBMFDefs;
 
-#include <QDataStream>
-
-#include "../Kerning/kerningModel.h"
+#include "BitmapCache.hpp"
+#include "ByteSink.hpp"
+#include "CodePointTable.hpp"
+#include "LigKernPairIndex.hpp"
 #include "RLEExtractor.hpp"
 #include "RLEGenerator.hpp"
 
@@ -33,25 +39,107 @@ using namespace IBMFDefs;
 class IBMFFontMod {
 public:
   struct Face {
-    FaceHeaderPtr                header;
-    std::vector<GlyphInfoPtr>    glyphs;
-    std::vector<BitmapPtr>       bitmaps;
-    std::vector<GlyphLigKernPtr> glyphsLigKern; // Specific to each glyph
+    FaceHeaderPtr          header;
+    std::vector<GlyphInfo> glyphs;  // Packed, indexed by glyph code
+    std::vector<BitmapPtr> bitmaps; // Edited or imported glyphs only, else nullptr
+
+    // Compressed bitmaps of all glyphs in a single pixels pool, with the index
+    // of each glyph's bitmap in the pool. When the font is used in place, the
+    // pool is a view into the font memory, else it is held by pixelsPoolData.
+    // Glyphs without an entry in bitmaps are retrieved from the pool on demand
+    // through the bitmap cache.
+    const uint8_t              *pixelsPool{nullptr};
+    Pixels                      pixelsPoolData;
+    std::vector<PixelPoolIndex> pixelsPoolIndexes;
+
+    // Ligature and kerning steps of all glyphs in two flat arrays. Each glyph
+    // owns a range of entries in both of them. Entries left out of the ranges
+    // by setGlyphLigKern() are orphaned until the arrays are compacted.
+    std::vector<GlyphLigStep>      ligSteps;
+    std::vector<GlyphKernStep>     kernSteps;
+    std::vector<GlyphLigKernRange> ligKernRanges;
+    size_t                         orphanedStepCount{0};
+
+    // Index of the ligature and kerning pairs. It is built from the steps
+    // when first required, then kept in sync with them.
+    mutable LigKernPairIndex  ligKernPairs;
+    mutable std::atomic<bool> ligKernPairsReady{false};
+    mutable std::mutex        ligKernPairsMutex;
+
+    // used at load and save time
+    std::vector<LigKernStep> ligKernSteps; // The complete list of lig/kerns
+
+    // Changes since the face was loaded or last saved. Only the modified
+    // bitmaps are compressed again at save time, the others being copied from
+    // the pixels pool. The lig/kern steps are rebuilt only when some glyph
+    // lig/kern changed. Faces built by the importers are fully modified.
+    bool                 modified{true};        // Anything in the face
+    bool                 ligKernModified{true}; // Some glyph lig/kern steps
+    std::vector<uint8_t> modifiedBitmaps;       // Indexed by glyph code, true if absent
 
-    // used ontly at save and load time
-    std::vector<RLEBitmapPtr> compressedBitmaps; // Todo: maybe unused at the end
+    auto addGlyphLigKern(const GlyphLigKern &glyphLigKern) -> void;
+    auto setGlyphLigKern(GlyphCode glyphCode, const GlyphLigKern &glyphLigKern) -> void;
+    auto getGlyphLigKern(GlyphCode glyphCode) const -> GlyphLigKernPtr;
 
-    // used only at save time
-    std::vector<LigKernStepPtr> ligKernSteps; // The complete list of lig/kerns
+    auto findLigKernPair(GlyphCode glyphCode, GlyphCode nextGlyphCode) const
+        -> const LigKernPair *;
+
+  private:
+    auto compactLigKernSteps() -> void;
+    auto indexLigKernPairs(GlyphCode glyphCode) const -> void;
+    auto unindexLigKernPairs(GlyphCode glyphCode) -> void;
   };
 
   typedef std::unique_ptr<Face> FacePtr;
 
+  // Edges of a glyph for optical kerning, one entry per row: the leftmost
+  // black column of the row and the rightmost black column of the row and its
+  // two neighbours (right has 2 more entries, for rows -1 and height). Rows
+  // without black pixels are NO_LEFT and NO_RIGHT, such that they never face
+  // each other closer than any real pixels.
+  struct GlyphProfile {
+    static constexpr int16_t NO_LEFT  = INT16_MAX;
+    static constexpr int16_t NO_RIGHT = INT16_MIN;
+
+    std::vector<int16_t> left;
+    std::vector<int16_t> right;
+  };
+
+  struct AutoKerningStats {
+    uint64_t pairCount;            // Pairs of glyphs evaluated, in all faces
+    uint64_t kernStepCount;        // Kerning steps written, in all faces
+    uint64_t droppedKernStepCount; // Kerning steps left out for the lig/kern tables to fit
+  };
+
+  // Lig/kern steps of the glyphs kerned by prepareAutoKerning(), by face.
+  struct AutoKerning {
+    std::vector<std::vector<std::pair<GlyphCode, GlyphLigKern>>> glyphLigKerns;
+    AutoKerningStats                                             stats;
+  };
+
+  // Progress of prepareAutoKerning(), followed and canceled from another
+  // thread: the first glyphs of the pairs kerned so far, in all faces.
+  struct AutoKerningProgress {
+    std::atomic<uint64_t> firstGlyphCount{0};
+    std::atomic<uint64_t> doneFirstGlyphCount{0};
+    std::atomic<bool>     canceled{false};
+  };
+
   IBMFFontMod(uint8_t *memoryFont, uint32_t size) : memory_(memoryFont), memoryLength_(size) {
     initialized_ = load();
     lastError_   = 0;
   }
 
+  // Zero-copy loading: the font memory (usually a privately memory-mapped
+  // file) is kept alive by the memoryHolder for the life of the font. The
+  // compressed bitmaps are used in place; glyph information and lig/kern
+  // steps are copied in a single block per face.
+  IBMFFontMod(std::shared_ptr<uint8_t> memoryHolder, uint32_t size)
+      : memoryHolder_(memoryHolder), memory_(memoryHolder.get()), memoryLength_(size) {
+    initialized_ = load();
+    lastError_   = 0;
+  }
+
   // The following constructor is used ONLY for importing other font formats.
   // A specific load method must then be used to retrieve the font information
   // and populate the structure from that foreign format.
@@ -63,7 +151,14 @@ public:
 
   inline auto getPreamble() const -> Preamble { return preamble_; }
   inline auto isInitialized() const -> bool { return initialized_; }
+
+  // Errors are reported through the return value of the methods (false) and
+  // described by the following. Non-fatal issues encountered when importing
+  // a font are kept as warnings.
   inline auto getLastError() const -> int { return lastError_; }
+  inline auto getLastErrorMessage() const -> const std::string & { return lastErrorMessage_; }
+  inline auto getWarnings() const -> const std::vector<std::string> & { return warnings_; }
+
   inline auto getLineHeight(int faceIdx) const -> int {
     return faceIdx < preamble_.faceCount ? faces_[faceIdx]->header->lineHeight : 0;
   }
@@ -84,41 +179,158 @@ public:
   auto ligKern(int faceIndex, const GlyphCode glyphCode1, GlyphCode *glyphCode2, FIX16 *kern,
                bool *kernPairPresent) const -> bool;
   auto getGlyphLigKern(int faceIndex, int glyphCode, GlyphLigKernPtr *glyphLigKern) const -> bool;
+  auto setGlyphLigKern(int faceIndex, int glyphCode, const GlyphLigKern &glyphLigKern) -> bool;
+  // The glyph information is a copy, owned by the caller: it is not updated
+  // by later changes to the font. The bitmap is shared with the font and must
+  // not be modified.
   auto getGlyph(int faceIndex, int glyphCode, GlyphInfoPtr &glyph_info, BitmapPtr *bitmap) const
       -> bool;
   auto saveFaceHeader(int faceIndex, FaceHeader &face_header) -> bool;
   auto saveGlyph(int faceIndex, int glyphCode, GlyphInfo *newGlyphInfo, BitmapPtr new_bitmap)
       -> bool;
   auto convertToOneBit(const Bitmap &bitmapHeightBits, BitmapPtr *bitmapOneBit) -> bool;
-  auto save(QDataStream &out) -> bool;
+  static auto computeAutoKerning(const Bitmap &b1, const Bitmap &b2, const GlyphInfo &i1,
+                                 const GlyphInfo &i2) -> FIX16;
+  static auto computeAutoKerning(const GlyphProfile &p1, const GlyphProfile &p2,
+                                 const GlyphInfo &i1, const GlyphInfo &i2) -> FIX16;
+  static auto computeGlyphProfile(const Bitmap &bitmap, GlyphProfile &profile) -> void;
+
+  // Optical kerning of all the pairs of a set of glyphs, in all faces. The
+  // pairs kerned by at least minKern (in absolute value) are written in the
+  // kerning steps of their first glyph, replacing any step for the same pair.
+  // Steps of the other pairs are kept untouched. When the lig/kern table of a
+  // face would not fit in the font format, the smallest kernings are left out.
+  auto generateAutoKerning(const std::vector<GlyphCode> &glyphCodes, FIX16 minKern)
+      -> AutoKerningStats;
+
+  // generateAutoKerning() in two steps, such that the kerning can be computed
+  // by a worker thread while the font is used, then applied to the font by the
+  // thread using it. The font must not be modified in between. When canceled
+  // through progress, the result is empty.
+  auto prepareAutoKerning(const std::vector<GlyphCode> &glyphCodes, FIX16 minKern,
+                          AutoKerningProgress *progress = nullptr) const -> AutoKerning;
+  auto applyAutoKerning(const AutoKerning &kerning) -> AutoKerningStats;
+
+  // Glyphs being edited are kept in the bitmap cache until unpinned.
+  inline auto pinGlyph(int faceIndex, int glyphCode) -> void {
+    bitmapCache_.pin(faceIndex, glyphCode);
+  }
+  inline auto unpinGlyph(int faceIndex, int glyphCode) -> void {
+    bitmapCache_.unpin(faceIndex, glyphCode);
+  }
+  inline auto setBitmapCacheBudget(size_t budget) -> void { bitmapCache_.setBudget(budget); }
+  inline auto getBitmapCacheSize() const -> size_t { return bitmapCache_.getSize(); }
+
+  // The compressed bitmaps of the faces not modified since loaded or saved
+  // are saved from the font memory as is. When the font is used in place,
+  // that memory must stay unchanged until the end of the save: the font must
+  // be detached from it before writing over the file it was loaded from.
+  auto save(ByteSink &out) -> bool;
+  auto isModified() const -> bool;
+
+  // Copies the pixels pools still used in place in the font memory, then
+  // releases that memory (e.g. the file mapping).
+  auto detachMemory() -> void;
+  inline auto isInPlace() const -> bool { return memoryHolder_ != nullptr; }
+
+  // The lig/kern pgms of the glyphs are reordered at save time to reduce the
+  // number of lig/kern steps, when optimized. The number of steps saved by
+  // the last save is reported, compared to the pgms kept in glyph order.
+  auto        setLigKernOptimization(bool optimize) -> void;
+  inline auto getLigKernStepsSaved() const -> int { return ligKernStepsSaved_; }
   auto translate(char32_t codePoint) const -> GlyphCode;
+  auto translate(const std::vector<char32_t> &codePoints, std::vector<GlyphCode> &glyphCodes) const
+      -> void;
   auto getUTF32(GlyphCode glyphCode) const -> char32_t;
   auto toGlyphCode(char32_t codePoint) const -> GlyphCode;
 
+  // Text decoding into code points, to be translated in a single pass.
+  // Invalid sequences are decoded as U+FFFD.
+  static auto decodeUTF8(const char *text, size_t size, std::vector<char32_t> &codePoints)
+      -> void;
+  static auto decodeUTF16(const char16_t *text, size_t size, std::vector<char32_t> &codePoints)
+      -> void;
+
 protected:
-  static constexpr uint8_t IBMF_VERSION = 4;
+  static constexpr uint8_t IBMF_VERSION      = 4;
+  static constexpr int     AUTO_KERNING_SIZE = 1; // Minimum space between glyphs, in pixels
 
   Preamble preamble_;
 
   std::vector<Plane>           planes_;
   std::vector<CodePointBundle> codePointBundles_;
+  CodePointTable               codePointTable_; // Built from the planes and bundles
   std::vector<FacePtr>         faces_;
 
+  std::vector<std::string> warnings_;
+
+  inline auto setError(int error, const std::string &message) -> bool {
+    lastError_        = error;
+    lastErrorMessage_ = message;
+    return false;
+  }
+  inline auto clearError() -> void {
+    lastError_ = 0;
+    lastErrorMessage_.clear();
+  }
+
+  auto prepareLigKernVectors() -> bool;
+
 private:
   static constexpr uint8_t MAX_GLYPH_COUNT = 254; // Index Value 0xFE and 0xFF are reserved
+  static constexpr size_t  GLYPH_GRAIN_SIZE  = 512; // Glyphs per parallel load task
+  static constexpr size_t  ENCODE_GRAIN_SIZE = 128; // Glyphs per parallel encoding task
+  static constexpr size_t  KERN_GRAIN_SIZE   = 16;  // First glyphs per parallel kerning task
+
+  static constexpr size_t MAX_LIG_KERN_STEP_COUNT = 0xFFFF; // FaceHeader::ligKernStepCount
+  static constexpr int    MAX_GOTO_DISPLACEMENT   = 0x3FFF; // LigKernStep goTo displacement
 
   bool initialized_;
 
   std::vector<uint32_t> faceOffsets_;
 
-  uint8_t *memory_;
-  uint32_t memoryLength_;
+  std::shared_ptr<uint8_t> memoryHolder_; // Non null when the font is used in place
+  uint8_t                 *memory_;
+  uint32_t                 memoryLength_;
 
-  int lastError_;
+  int         lastError_{0};
+  std::string lastErrorMessage_;
 
-  auto findList(std::vector<LigKernStepPtr> &pgm, std::vector<LigKernStepPtr> &list) const -> int;
-  auto prepareLigKernVectors() -> bool;
+  bool optimizeLigKern_{false};
+  int  ligKernStepsSaved_{0};
+
+  mutable BitmapCache bitmapCache_;
+
+  auto retrieveBitmap(int faceIndex, int glyphCode) const -> BitmapPtr;
+  auto encodeBitmaps() -> bool;
+  // Start index of the ends of the lig/kern pgms, by hash of their steps
+  typedef std::unordered_map<uint64_t, int> LigKernSuffixes;
+
+  auto findList(const std::vector<LigKernStep> &pgm, const std::vector<LigKernStep> &list,
+                const LigKernSuffixes &suffixes) const -> int;
+  static auto hashLigKernStep(uint64_t hash, const LigKernStep &step) -> uint64_t;
+  static auto hashLigKernSteps(const LigKernStep *first, const LigKernStep *last) -> uint64_t;
+  static auto addListSuffixes(const std::vector<LigKernStep> &list, int first,
+                              LigKernSuffixes &suffixes) -> void;
+  static auto buildLigKernPgm(const Face &face, int glyphCode, std::vector<LigKernStep> &pgm)
+      -> void;
+  auto packLigKernPgms(const Face &face, std::vector<LigKernStep> &lkSteps,
+                       std::vector<int> &glyphsPgmIndexes, std::set<int> &uniquePgmIndexes) const
+      -> void;
+  auto optimizeLigKernPgms(const Face &face, std::vector<LigKernStep> &lkSteps,
+                           std::vector<int> &glyphsPgmIndexes,
+                           std::set<int>    &uniquePgmIndexes) const -> void;
+  static auto findLigKernOverflows(const std::vector<LigKernStep> &lkSteps,
+                                   const std::set<int> &uniquePgmIndexes,
+                                   std::set<int> &overflowList, int &newLigKernIdx) -> int;
+  static auto ligKernTooLarge(size_t stepCount, const std::set<int> &overflowList,
+                              int spaceRequired, int newLigKernIdx) -> bool;
+  auto        ligKernFits(const Face &face) const -> bool;
   auto load() -> bool;
+  auto loadFace(uint32_t idx, Face &face) const -> bool;
+
+  template <typename StepFn>
+  static auto decodeLigKernPgm(const Face &face, GlyphCode glyphCode, StepFn stepFn) -> void;
 };
 
 typedef std::shared_ptr<IBMFFontMod> IBMFFontModPtr;
@@ -122,15 +122,14 @@ end3:
 
 end2:
 end4:
-      bitmap->dim   = Dim(lastCol - firstCol + 1, lastRow - firstRow + 1);
-      vOffset       = 14 - firstRow;
+      bitmap->setDim(Dim(lastCol - firstCol + 1, lastRow - firstRow + 1));
+      vOffset = 14 - firstRow;
 
       uint8_t *buff = bytes.data() + (firstRow * byteWidth);
       for (int row = firstRow; row <= lastRow; row++) {
         uint8_t mask = 0x80 >> (firstCol & 7);
         for (int col = firstCol; col <= lastCol; col++) {
-          uint8_t pixel = ((buff[col >> 3] & mask) == 0) ? 0 : 0xFF;
-          bitmap->pixels.push_back(pixel);
+          if ((buff[col >> 3] & mask) != 0) bitmap->setPixel(col - firstCol, row - firstRow, true);
           mask >>= 1;
           if (mask == 0) mask = 0x80;
         }
@@ -151,8 +150,7 @@ noCode:
     return NO_GLYPH_CODE;
 
 spaceCode:
-    bitmap->dim = Dim(0, 0);
-    bitmap->pixels.clear();
+    bitmap->clear();
     vOffset = 0;
     return SPACE_CODE;
   }
@@ -250,6 +248,8 @@ auto IBMFHexImport::prepareCodePlanes(std::fstream &in, CharSelectionsPtr &charS
       planes_[idx].codePointBundlesIdx = codePointBundles_.size();
       planes_[idx].firstGlyphCode      = glyphCode;
     }
+
+    codePointTable_.build(planes_, codePointBundles_);
   }
 
   return glyphCode;
@@ -272,8 +272,8 @@ auto IBMFHexImport::loadHex(FontParametersPtr fontParameters) -> bool {
   CharSelectionsPtr sel = fontParameters->charSelections;
 
   std::fstream in;
-  QString      filename = (*sel)[0].filename;
-  in.open(filename.toStdString(), std::ios::in);
+  std::string  filename = (*sel)[0].filename;
+  in.open(filename, std::ios::in);
 
   if (in.is_open()) {
 
@@ -281,13 +281,13 @@ auto IBMFHexImport::loadHex(FontParametersPtr fontParameters) -> bool {
 
     if (glyphCount <= 0) {
       in.close();
-      return false;
+      return setError(8, "No character selected in file " + filename);
     }
 
     FacePtr face = FacePtr(new Face);
 
     in.close();
-    in.open(filename.toStdString(), std::ios::in);
+    in.open(filename, std::ios::in);
 
     while (!in.eof()) {
       char32_t  codePoint;
@@ -299,7 +299,7 @@ auto IBMFHexImport::loadHex(FontParametersPtr fontParameters) -> bool {
 
         face->bitmaps.push_back(bitmap);
 
-        GlyphLigKernPtr glyphLigKern = GlyphLigKernPtr(new GlyphLigKern);
+        GlyphLigKern glyphLigKern;
 
         // Create ligatures for the glyph if available
         // Ensure that both next and replacement glyph codes are present in the
@@ -310,18 +310,17 @@ auto IBMFHexImport::loadHex(FontParametersPtr fontParameters) -> bool {
             GlyphCode nextGlyphCode        = toGlyphCode(ligature.nextChar);
             GlyphCode replacementGlyphCode = toGlyphCode(ligature.replacement);
             if ((nextGlyphCode != NO_GLYPH_CODE) && (replacementGlyphCode != NO_GLYPH_CODE)) {
-              GlyphLigStepPtr glyphLigStep = GlyphLigStepPtr(new GlyphLigStep(GlyphLigStep{
-                  .nextGlyphCode = nextGlyphCode, .replacementGlyphCode = replacementGlyphCode}));
-              glyphLigKern->ligSteps.push_back(glyphLigStep);
+              glyphLigKern.ligSteps.push_back(GlyphLigStep{
+                  .nextGlyphCode = nextGlyphCode, .replacementGlyphCode = replacementGlyphCode});
             }
           }
         }
 
-        face->glyphsLigKern.push_back(glyphLigKern);
+        face->addGlyphLigKern(glyphLigKern);
 
         // ----- Glyph Info -----
 
-        GlyphInfoPtr glyphInfo = GlyphInfoPtr(new GlyphInfo(GlyphInfo{
+        face->glyphs.push_back(GlyphInfo{
             .bitmapWidth      = static_cast<uint8_t>(bitmap->dim.width),
             .bitmapHeight     = static_cast<uint8_t>(bitmap->dim.height),
             .horizontalOffset = static_cast<int8_t>(0),
@@ -331,9 +330,7 @@ auto IBMFHexImport::loadHex(FontParametersPtr fontParameters) -> bool {
             .rleMetrics       = RLEMetrics{.dynF = 0, .firstIsBlack = false, .filler = 0},
             .ligKernPgmIndex  = 0, // completed at save time
             .mainCode         = glyphCode  // No composite management (for now)
-        }));
-
-        face->glyphs.push_back(glyphInfo);
+        });
       }
     }
 
@@ -359,5 +356,5 @@ auto IBMFHexImport::loadHex(FontParametersPtr fontParameters) -> bool {
     return true;
   }
 
-  return false;
+  return setError(8, "Unable to open file " + filename);
 }
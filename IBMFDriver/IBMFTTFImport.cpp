@@ -1,6 +1,13 @@
 #include "IBMFTTFImport.hpp"
 
-#include <QMessageBox>
+#include <cstdio>
+#include <cstring>
+
+static auto codePointStr(char32_t ch) -> std::string {
+  char buff[16];
+  snprintf(buff, sizeof(buff), "U+%05x", static_cast<unsigned int>(ch));
+  return buff;
+}
 
 auto IBMFTTFImport::prepareCodePlanes(FT_Face &face, CharSelections &charSelections) -> int {
 
@@ -76,6 +83,8 @@ auto IBMFTTFImport::prepareCodePlanes(FT_Face &face, CharSelections &charSelecti
       planes_[idx].codePointBundlesIdx = codePointBundles_.size();
       planes_[idx].firstGlyphCode      = glyphCode;
     }
+
+    codePointTable_.build(planes_, codePointBundles_);
   }
 
   return glyphCode;
@@ -185,7 +194,7 @@ auto IBMFTTFImport::loadTTF(FreeType &ft, FontParametersPtr fontParameters) -> b
 
   CharSelectionsPtr sel = fontParameters->charSelections;
   if (sel->size() == 1) {
-    QString filename = (*sel)[0].filename;
+    std::string filename = (*sel)[0].filename;
 
     FT_Face ftFace;
     if ((ftFace = ft.openFace(filename)) != nullptr) {
@@ -203,10 +212,9 @@ auto IBMFTTFImport::loadTTF(FreeType &ft, FontParametersPtr fontParameters) -> b
       // This is a test that could be removed in the future
       for (GlyphCode i = 0; i < glyphCount; i++) {
         if ((i != toGlyphCode(getUTF32(i)))) {
-          QMessageBox::critical(nullptr, "Internal Error!!",
-                                QString("Problem with getUTF32() and toGlyphCode() that are not "
-                                        "orthogonal for glyphCode %1")
-                                    .arg(i));
+          warnings_.push_back("Internal Error: Problem with getUTF32() and toGlyphCode() that "
+                              "are not orthogonal for glyphCode " +
+                              std::to_string(i));
         }
       }
 
@@ -218,8 +226,7 @@ auto IBMFTTFImport::loadTTF(FreeType &ft, FontParametersPtr fontParameters) -> b
                              fontParameters->dpi,      // horizontal device resolution
                              fontParameters->dpi);
         if (error != 0) {
-          QMessageBox::critical(nullptr, "FreeType issue", "Unable to set face sizes");
-          return false;
+          return setError(8, "FreeType issue: Unable to set face sizes");
         }
 
         FacePtr face = FacePtr(new Face);
@@ -233,43 +240,40 @@ auto IBMFTTFImport::loadTTF(FreeType &ft, FontParametersPtr fontParameters) -> b
           if (index != 0) {
             error = FT_Load_Char(ftFace, ch, FT_LOAD_DEFAULT);
             if (error != 0) {
-              QMessageBox::critical(
-                  nullptr, "FreeType issue",
-                  QString("Unable to load codePoint U+%1").arg(ch, 5, 16, QChar('0')));
-              return false;
+              return setError(8, "FreeType issue: Unable to load codePoint " + codePointStr(ch));
             }
 
             if (ftFace->glyph->format != FT_GLYPH_FORMAT_BITMAP) {
               error = FT_Render_Glyph(ftFace->glyph, FT_RENDER_MODE_MONO);
               if (error != 0) {
-                QMessageBox::critical(
-                    nullptr, "FreeType issue",
-                    QString("Unable to render codePoint U+%1").arg(ch, 5, 16, QChar('0')));
-                return false;
+                return setError(8,
+                                "FreeType issue: Unable to render codePoint " + codePointStr(ch));
               }
             }
 
             // ----- Bitmap -----
 
-            BitmapPtr bitmap = BitmapPtr(new Bitmap());
-            uint8_t  *buffer = ftFace->glyph->bitmap.buffer;
-            for (int row = 0; row < ftFace->glyph->bitmap.rows; row++) {
-              uint8_t mask = 0x80;
-              for (int col = 0; col < ftFace->glyph->bitmap.width; col++) {
-                uint8_t pixel = ((buffer[col >> 3] & mask) == 0) ? 0 : 0xFF;
-                bitmap->pixels.push_back(pixel);
-                mask >>= 1;
-                if (mask == 0) mask = 0x80;
+            // The FreeType mono bitmap rows are in the IBMF one bit layout
+            // already: they are copied as is, the padding bits being cleared.
+
+            BitmapPtr bitmap = BitmapPtr(
+                new Bitmap(Dim(ftFace->glyph->bitmap.width, ftFace->glyph->bitmap.rows)));
+            uint8_t  *buffer    = ftFace->glyph->bitmap.buffer;
+            int       byteCount = (bitmap->dim.width + 7) >> 3;
+            for (int row = 0; row < bitmap->dim.height; row++) {
+              MemoryPtr rowPtr = bitmap->rowPtr(row);
+              memcpy(rowPtr, buffer, byteCount);
+              if ((bitmap->dim.width & 7) != 0) {
+                rowPtr[byteCount - 1] &= 0xFF << (8 - (bitmap->dim.width & 7));
               }
               buffer += ftFace->glyph->bitmap.pitch;
             }
-            bitmap->dim = Dim(ftFace->glyph->bitmap.width, ftFace->glyph->bitmap.rows);
 
             face->bitmaps.push_back(bitmap);
 
             // ----- Ligature / Kerning -----
 
-            GlyphLigKernPtr glyphLigKern = GlyphLigKernPtr(new GlyphLigKern);
+            GlyphLigKern glyphLigKern;
 
             // Create ligatures for the glyph if available
             // Ensure that both next and replacement glyph codes are present in the
@@ -280,10 +284,9 @@ auto IBMFTTFImport::loadTTF(FreeType &ft, FontParametersPtr fontParameters) -> b
                 GlyphCode nextGlyphCode        = toGlyphCode(ligature.nextChar);
                 GlyphCode replacementGlyphCode = toGlyphCode(ligature.replacement);
                 if ((nextGlyphCode != NO_GLYPH_CODE) && (replacementGlyphCode != NO_GLYPH_CODE)) {
-                  GlyphLigStepPtr glyphLigStep = GlyphLigStepPtr(
-                      new GlyphLigStep(GlyphLigStep{.nextGlyphCode        = nextGlyphCode,
-                                                    .replacementGlyphCode = replacementGlyphCode}));
-                  glyphLigKern->ligSteps.push_back(glyphLigStep);
+                  glyphLigKern.ligSteps.push_back(
+                      GlyphLigStep{.nextGlyphCode        = nextGlyphCode,
+                                   .replacementGlyphCode = replacementGlyphCode});
                 }
               }
             }
@@ -308,20 +311,19 @@ auto IBMFTTFImport::loadTTF(FreeType &ft, FontParametersPtr fontParameters) -> b
                     auto kern = static_cast<FIX16>(akerning.x);
 
                     if (kern != 0) {
-                      GlyphKernStepPtr glyphKernStep = GlyphKernStepPtr(new GlyphKernStep(
-                          GlyphKernStep{.nextGlyphCode = glyphCode2, .kern = kern}));
-                      glyphLigKern->kernSteps.push_back(glyphKernStep);
+                      glyphLigKern.kernSteps.push_back(
+                          GlyphKernStep{.nextGlyphCode = glyphCode2, .kern = kern});
                     }
                   }
                 }
               }
             }
 
-            face->glyphsLigKern.push_back(glyphLigKern);
+            face->addGlyphLigKern(glyphLigKern);
 
             // ----- Glyph Info -----
 
-            GlyphInfoPtr glyphInfo = GlyphInfoPtr(new GlyphInfo(GlyphInfo{
+            face->glyphs.push_back(GlyphInfo{
                 .bitmapWidth      = static_cast<uint8_t>(ftFace->glyph->bitmap.width),
                 .bitmapHeight     = static_cast<uint8_t>(ftFace->glyph->bitmap.rows),
                 .horizontalOffset = static_cast<int8_t>(-ftFace->glyph->bitmap_left),
@@ -332,14 +334,10 @@ auto IBMFTTFImport::loadTTF(FreeType &ft, FontParametersPtr fontParameters) -> b
                 .rleMetrics      = RLEMetrics{.dynF = 0, .firstIsBlack = false, .filler = 0},
                 .ligKernPgmIndex = 0, // completed at save time
                 .mainCode        = glyphCode  // maybe changed below when searching for composites
-            }));
-
-            face->glyphs.push_back(glyphInfo);
+            });
           } else {
-            QMessageBox::critical(
-                nullptr, "Internal error!",
-                QString("Can't find utf32 codePoint for glyphCode %1)").arg(glyphCode));
-            return false;
+            return setError(8, "Internal error: Can't find utf32 codePoint for glyphCode " +
+                                   std::to_string(glyphCode));
           }
         }
 
@@ -371,14 +369,14 @@ auto IBMFTTFImport::loadTTF(FreeType &ft, FontParametersPtr fontParameters) -> b
                 GlyphCode code = findGlyphCodeFromIndex(p_index, ftFace, glyphCount);
 
                 if (code != NO_GLYPH_CODE) {
-                  face->glyphs[glyphCode]->mainCode = code;
+                  face->glyphs[glyphCode].mainCode = code;
                   // std::cout << "Composite main code: " << code << " for glyphCode " << glyphCode
                   //           << "(U+" << std::hex << std::setfill('0') << std::setw(5) << ch
                   //           << std::dec << ")" << std::endl;
-                  if (face->glyphsLigKern[glyphCode]->kernSteps.size() == 0) {
-                    std::copy(face->glyphsLigKern[code]->kernSteps.begin(),
-                              face->glyphsLigKern[code]->kernSteps.end(),
-                              std::back_inserter(face->glyphsLigKern[glyphCode]->kernSteps));
+                  GlyphLigKernPtr glyphLigKern = face->getGlyphLigKern(glyphCode);
+                  if (glyphLigKern->kernSteps.size() == 0) {
+                    glyphLigKern->kernSteps = face->getGlyphLigKern(code)->kernSteps;
+                    face->setGlyphLigKern(glyphCode, *glyphLigKern);
                     // if (face->glyphsLigKern[glyphCode]->kernSteps.size() != 0) {
                     //  std::cout << "Got a main composite with augmented kern vector: "
                     //            << glyphCode << std::endl;
@@ -404,8 +402,7 @@ auto IBMFTTFImport::loadTTF(FreeType &ft, FontParametersPtr fontParameters) -> b
             FT_Load_Char(ftFace, 'x', FT_LOAD_MONOCHROME);
             xHeight = static_cast<FIX16>(ftFace->glyph->metrics.height);
           } else {
-            QMessageBox::warning(nullptr, "No 'x' character",
-                                 "There is no 'x' character in this font");
+            warnings_.push_back("There is no 'x' character in this font");
           }
         }
 
@@ -421,8 +418,7 @@ auto IBMFTTFImport::loadTTF(FreeType &ft, FontParametersPtr fontParameters) -> b
           FT_Load_Char(ftFace, ' ', FT_LOAD_NO_BITMAP);
           spaceSize = static_cast<uint8_t>(ftFace->glyph->metrics.horiAdvance >> 6);
         } else {
-          QMessageBox::warning(nullptr, "No space character",
-                               "There is no space character in this font");
+          warnings_.push_back("There is no space character in this font");
         }
 
         // ----- Face Header -----
@@ -443,10 +439,10 @@ auto IBMFTTFImport::loadTTF(FreeType &ft, FontParametersPtr fontParameters) -> b
         faces_.push_back(std::move(face));
       }
     } else {
-      return false;
+      return setError(8, ft.getLastErrorMessage());
     }
   } else {
-    return false;
+    return setError(8, "A single font file selection is expected");
   }
   return true;
 }
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include "IBMFDefs.hpp"
+
+using namespace IBMFDefs;
+
+// An entry of the index. For a pair of glyph codes, it holds the first
+// ligature step of the first glyph for the second one or, if none, its first
+// kerning step.
+
+struct LigKernPair {
+  enum Kind : uint8_t { EMPTY, LIGATURE, KERN, REMOVED };
+
+  uint32_t key;   // First glyph code << 16 | next glyph code
+  uint16_t value; // Replacement glyph code or kerning value
+  Kind     kind;
+};
+
+/**
+ * @brief Ligature and kerning pairs of a face.
+ *
+ * An open addressing hash table with linear probing, such that the ligature
+ * or kerning step for a pair of glyphs is retrieved in a single probe most of
+ * the time, whatever the length of the glyph's lig/kern steps. At most half of
+ * the entries are in use, counting the removed entries, which are kept as such
+ * until the table is rehashed. The table is rehashed at the same size when
+ * the removed entries make most of that half, else it is doubled, such that
+ * repeated removals and insertions neither lengthen the probes nor grow it.
+ *
+ * The first ligature step for a pair has precedence over the kerning steps,
+ * then the first kerning step over the following ones, as when the steps are
+ * searched in sequence: the steps of a glyph must be inserted in sequence,
+ * ligatures first.
+ */
+class LigKernPairIndex {
+public:
+  inline auto find(GlyphCode glyphCode, GlyphCode nextGlyphCode) const -> const LigKernPair * {
+    size_t slot = findSlot(key(glyphCode, nextGlyphCode));
+    return (slot < pairs_.size()) ? &pairs_[slot] : nullptr;
+  }
+
+  auto insert(GlyphCode glyphCode, GlyphCode nextGlyphCode, uint16_t value,
+              LigKernPair::Kind kind) -> void {
+    if (((used_ + 1) * 2) > pairs_.size()) {
+      bool crowded = ((live_ + 1) * 4) > pairs_.size();
+      resize(std::max<size_t>(64, crowded ? pairs_.size() * 2 : pairs_.size()));
+    }
+
+    uint32_t     k       = key(glyphCode, nextGlyphCode);
+    size_t       mask    = pairs_.size() - 1;
+    LigKernPair *removed = nullptr;
+    for (size_t slot = hash(k, mask);; slot = (slot + 1) & mask) {
+      LigKernPair &pair = pairs_[slot];
+      if (pair.kind == LigKernPair::EMPTY) {
+        if (removed == nullptr) {
+          removed = &pair;
+          used_ += 1;
+        }
+        *removed = LigKernPair{.key = k, .value = value, .kind = kind};
+        live_ += 1;
+        return;
+      }
+      if (pair.kind == LigKernPair::REMOVED) {
+        if (removed == nullptr) removed = &pair;
+      } else if (pair.key == k) {
+        if ((pair.kind == LigKernPair::KERN) && (kind == LigKernPair::LIGATURE)) {
+          pair = LigKernPair{.key = k, .value = value, .kind = kind};
+        }
+        return;
+      }
+    }
+  }
+
+  auto remove(GlyphCode glyphCode, GlyphCode nextGlyphCode) -> void {
+    size_t slot = findSlot(key(glyphCode, nextGlyphCode));
+    if (slot < pairs_.size()) {
+      pairs_[slot].kind = LigKernPair::REMOVED;
+      live_ -= 1;
+    }
+  }
+
+  inline auto capacity() const -> size_t { return pairs_.size(); }
+
+  // Empty the index, sized for count pairs.
+  auto clear(size_t count = 0) -> void {
+    size_t size = 64;
+    while (size < (count * 2)) size *= 2;
+    pairs_.assign(size, LigKernPair{.key = 0, .value = 0, .kind = LigKernPair::EMPTY});
+    used_ = 0;
+    live_ = 0;
+  }
+
+private:
+  std::vector<LigKernPair> pairs_; // Size is zero or a power of 2
+  size_t                   used_{0}; // Including the removed entries
+  size_t                   live_{0}; // Excluding the removed entries
+
+  static inline auto key(GlyphCode glyphCode, GlyphCode nextGlyphCode) -> uint32_t {
+    return (static_cast<uint32_t>(glyphCode) << 16) | nextGlyphCode;
+  }
+
+  static inline auto hash(uint32_t key, size_t mask) -> size_t {
+    uint32_t h = key * 0x9E3779B1U;
+    return (h ^ (h >> 16)) & mask;
+  }
+
+  // Location of the pair in the table, or the size of the table if absent.
+  auto findSlot(uint32_t key) const -> size_t {
+    if (pairs_.empty()) return 0;
+
+    size_t mask = pairs_.size() - 1;
+    for (size_t slot = hash(key, mask);; slot = (slot + 1) & mask) {
+      const LigKernPair &pair = pairs_[slot];
+      if (pair.kind == LigKernPair::EMPTY) return pairs_.size();
+      if ((pair.key == key) && (pair.kind != LigKernPair::REMOVED)) return slot;
+    }
+  }
+
+  auto resize(size_t size) -> void {
+    std::vector<LigKernPair> pairs(size,
+                                   LigKernPair{.key = 0, .value = 0, .kind = LigKernPair::EMPTY});
+    pairs.swap(pairs_);
+    used_       = 0;
+
+    size_t mask = pairs_.size() - 1;
+    for (auto &pair : pairs) {
+      if ((pair.kind == LigKernPair::LIGATURE) || (pair.kind == LigKernPair::KERN)) {
+        size_t slot = hash(pair.key, mask);
+        while (pairs_[slot].kind != LigKernPair::EMPTY) slot = (slot + 1) & mask;
+        pairs_[slot] = pair;
+        used_ += 1;
+      }
+    }
+    live_ = used_;
+  }
+};
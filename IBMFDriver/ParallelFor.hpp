@@ -0,0 +1,182 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief A pool of worker threads running the chunks of parallel loops.
+ *
+ * The pool used by parallelFor() is started on first use and lives until the
+ * end of the process. Each loop queues a job; the workers and the calling
+ * thread take the job's chunks until none is left.
+ */
+class ParallelForPool {
+public:
+  struct Job {
+    size_t                                     first;
+    size_t                                     last;
+    size_t                                     grainSize;
+    size_t                                     chunkCount;
+    const std::function<void(size_t, size_t)> *fn;
+
+    std::atomic<size_t> nextChunk{0};
+    std::atomic<size_t> doneChunkCount{0};
+    std::atomic<bool>   failed{false};
+    std::exception_ptr  error; // First exception thrown by fn, guarded by mutex
+    std::mutex          mutex;
+    std::condition_variable done;
+  };
+  typedef std::shared_ptr<Job> JobPtr;
+
+  // threadCount worker threads, the threads running loops being extra workers.
+  explicit ParallelForPool(unsigned int threadCount) {
+    for (unsigned int i = 0; i < threadCount; i++) {
+      threads_.emplace_back([this]() { work(); });
+    }
+  }
+
+  // The pool used by parallelFor(), with a worker per hardware thread
+  // besides the calling one.
+  static auto instance() -> ParallelForPool & {
+    static ParallelForPool pool(std::max(1U, std::thread::hardware_concurrency()) - 1);
+    return pool;
+  }
+
+  // True when the current thread is running the chunks of a job: nested
+  // parallelFor() calls are then run inline.
+  static auto insideJob() -> bool & {
+    static thread_local bool inside = false;
+    return inside;
+  }
+
+  // See parallelFor().
+  auto forEachChunk(size_t first, size_t last, size_t grainSize,
+                    const std::function<void(size_t, size_t)> &fn) -> void {
+    if (last <= first) return;
+    if (grainSize == 0) grainSize = 1;
+
+    size_t chunkCount = (last - first + grainSize - 1) / grainSize;
+
+    if ((chunkCount <= 1) || threads_.empty() || insideJob()) {
+      fn(first, last);
+      return;
+    }
+
+    auto job        = std::make_shared<Job>();
+    job->first      = first;
+    job->last       = last;
+    job->grainSize  = grainSize;
+    job->chunkCount = chunkCount;
+    job->fn         = &fn;
+    run(job);
+  }
+
+  ~ParallelForPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    wakeUp_.notify_all();
+    for (auto &thread : threads_) thread.join();
+  }
+
+private:
+  std::vector<std::thread> threads_;
+  std::deque<JobPtr>       jobs_; // Jobs that may have chunks left, guarded by mutex_
+  std::mutex               mutex_;
+  std::condition_variable  wakeUp_;
+  bool                     stopping_ = false;
+
+  // Runs the job's chunks on the workers and the calling thread, and waits
+  // for all of them to be done. The first exception thrown by a chunk is
+  // rethrown once the job is done; the chunks not started yet are skipped.
+  auto run(const JobPtr &job) -> void {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      jobs_.push_back(job);
+    }
+    wakeUp_.notify_all();
+
+    runChunks(*job);
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      auto                        it = std::find(jobs_.begin(), jobs_.end(), job);
+      if (it != jobs_.end()) jobs_.erase(it);
+    }
+
+    std::unique_lock<std::mutex> lock(job->mutex);
+    job->done.wait(lock, [&job]() { return job->doneChunkCount == job->chunkCount; });
+    if (job->error != nullptr) std::rethrow_exception(job->error);
+  }
+
+  static auto runChunks(Job &job) -> void {
+    bool &inside = insideJob();
+    bool  outer  = inside;
+    inside       = true;
+
+    size_t chunk;
+    while ((chunk = job.nextChunk.fetch_add(1)) < job.chunkCount) {
+      if (!job.failed) {
+        size_t chunkFirst = job.first + (chunk * job.grainSize);
+        try {
+          (*job.fn)(chunkFirst, std::min(chunkFirst + job.grainSize, job.last));
+        } catch (...) {
+          std::lock_guard<std::mutex> lock(job.mutex);
+          if (job.error == nullptr) job.error = std::current_exception();
+          job.failed = true;
+        }
+      }
+      if ((job.doneChunkCount.fetch_add(1) + 1) == job.chunkCount) {
+        { std::lock_guard<std::mutex> lock(job.mutex); }
+        job.done.notify_all();
+      }
+    }
+
+    inside = outer;
+  }
+
+  auto work() -> void {
+    while (true) {
+      JobPtr job;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        wakeUp_.wait(lock, [this]() { return stopping_ || !jobs_.empty(); });
+        if (jobs_.empty()) return;
+        job = jobs_.front();
+        if (job->nextChunk >= job->chunkCount) {
+          jobs_.pop_front();
+          continue;
+        }
+      }
+      runChunks(*job);
+    }
+  }
+};
+
+/**
+ * @brief Run a function over a range of indexes on a pool of worker threads.
+ *
+ * The range [first, last) is split in chunks of grainSize indexes. Each worker
+ * thread of the pool takes the next available chunk until none is left, and
+ * calls fn(chunkFirst, chunkLast) for it. The calling thread is one of the
+ * workers. fn is called directly for the whole range when it holds a single
+ * chunk, or when parallelFor() is called from a chunk of another
+ * parallelFor(): a single level of parallelism is used.
+ *
+ * fn must be thread-safe as chunks are processed concurrently and in no
+ * particular order. If fn throws, the remaining chunks are skipped and the
+ * first exception is rethrown once the running chunks are done.
+ */
+inline auto parallelFor(size_t first, size_t last, size_t grainSize,
+                        const std::function<void(size_t, size_t)> &fn) -> void {
+  ParallelForPool::instance().forEachChunk(first, last, grainSize, fn);
+}
@@ -8,6 +8,45 @@
 
 using namespace IBMFDefs;
 
+// ----- Decoding tables -----
+
+// Packed numbers that are completely contained in a byte read on a byte
+// boundary, for each dynF value (0..13), indexed by the byte value:
+// - length = 2: the byte holds a two-nybble number
+// - length = 1: the first nybble is a one-nybble number (the second nybble
+//               starts the next number)
+// - length = 0: the general decoding is required (large number or repeat count)
+
+struct RLEPackedNumber {
+  uint16_t value;
+  uint8_t  length;
+};
+
+struct RLEPackedNumberTable {
+  RLEPackedNumber entries[14][256];
+};
+
+constexpr auto makeRLEPackedNumberTable() -> RLEPackedNumberTable {
+  RLEPackedNumberTable table{};
+  for (int dynF = 0; dynF < 14; dynF++) {
+    for (int byte = 0; byte < 256; byte++) {
+      int              first = byte >> 4;
+      RLEPackedNumber &entry = table.entries[dynF][byte];
+      if ((first != 0) && (first <= dynF)) {
+        entry = {.value = static_cast<uint16_t>(first), .length = 1};
+      } else if ((first > dynF) && (first < 14)) {
+        entry = {.value  = static_cast<uint16_t>(((first - dynF - 1) << 4) + (byte & 0x0F) + dynF + 1),
+                 .length = 2};
+      } else {
+        entry = {.value = 0, .length = 0};
+      }
+    }
+  }
+  return table;
+}
+
+inline constexpr RLEPackedNumberTable rlePackedNumbers = makeRLEPackedNumberTable();
+
 class RLEExtractor {
 private:
   uint32_t repeatCount;
@@ -111,164 +150,189 @@ private:
     return true;
   }
 
-  inline void copyOneRowEightBits(MemoryPtr fromLine, MemoryPtr toLine, int16_t fromCol,
-                                  int size) const {
-    memcpy(toLine + fromCol, fromLine + fromCol, size);
+  void copyOneRowOneBit(MemoryPtr fromLine, MemoryPtr toLine, int16_t fromCol, int size) const {
+    if (size <= 0) return;
+    int lastCol   = fromCol + size - 1;
+    int firstByte = fromCol >> 3;
+    int lastByte  = lastCol >> 3;
+    for (int i = firstByte; i <= lastByte; i++) {
+      uint8_t mask = 0xFF;
+      if (i == firstByte) mask &= 0xFF >> (fromCol & 7);
+      if (i == lastByte) mask &= 0xFF << (7 - (lastCol & 7));
+      toLine[i] |= (fromLine[i] & mask);
+    }
   }
 
-  void copyOneRowOneBit(MemoryPtr fromLine, MemoryPtr toLine, int16_t fromCol, int size) const {
-    uint8_t mask = 0x80 >> (fromCol & 7);
-    for (int col = fromCol; col < fromCol + size; col++) {
-      if constexpr (BLACK_ONE_BIT) {
-        toLine[col >> 3] |= (fromLine[col >> 3] & mask);
+  // Set count bits of a one bit per pixel line, starting at column col.
+  static inline void setBits(MemoryPtr line, uint32_t col, uint32_t count) {
+    uint32_t lastCol   = col + count - 1;
+    uint32_t firstByte = col >> 3;
+    uint32_t lastByte  = lastCol >> 3;
+    uint8_t  firstMask = 0xFF >> (col & 7);
+    uint8_t  lastMask  = 0xFF << (7 - (lastCol & 7));
+    if (firstByte == lastByte) {
+      line[firstByte] |= firstMask & lastMask;
+    } else {
+      line[firstByte] |= firstMask;
+      memset(line + firstByte + 1, 0xFF, lastByte - firstByte - 1);
+      line[lastByte] |= lastMask;
+    }
+  }
+
+  // Uncompressed bitmap: pixels are retrieved from a bit stream, most
+  // significant bit first, by chunks of up to 8 bits.
+  bool retrieveUncompressed(const RLEBitmap &fromBitmap, Bitmap &toBitmap, const Pos atOffset) {
+    uint32_t  width      = fromBitmap.dim.width;
+    uint32_t  height     = fromBitmap.dim.height;
+    uint64_t  pixelCount = static_cast<uint64_t>(width) * height;
+    uint64_t  available  = static_cast<uint64_t>(memoryEnd - memoryPtr) * 8;
+    uint64_t  remaining  = (available < pixelCount) ? available : pixelCount;
+    uint32_t  toRowSize  = toBitmap.rowSize();
+    MemoryPtr toRowPtr   = toBitmap.rowPtr(atOffset.y);
+
+    uint32_t bits        = 0; // Bit buffer, next bit at position bitCount - 1
+    uint32_t bitCount    = 0;
+
+    for (uint32_t fromRow = 0; (fromRow < height) && (remaining > 0);
+         fromRow++, toRowPtr += toRowSize) {
+      uint32_t toCol = atOffset.x;
+      uint32_t cols  = (remaining < width) ? remaining : width;
+      remaining -= cols;
+      while (cols > 0) {
+        uint32_t count = (cols < 8) ? cols : 8;
+        if (bitCount < count) {
+          bits = (bits << 8) | *memoryPtr++;
+          bitCount += 8;
+        }
+        bitCount -= count;
+        uint8_t chunk = static_cast<uint8_t>(((bits >> bitCount) & (0xFF >> (8 - count)))
+                                             << (8 - count));
+        uint8_t shift = toCol & 7;
+        toRowPtr[toCol >> 3] |= chunk >> shift;
+        if ((shift + count) > 8) toRowPtr[(toCol >> 3) + 1] |= chunk << (8 - shift);
+        toCol += count;
+        cols -= count;
+      }
+    }
+
+    if (available < pixelCount) {
+      std::cerr << "Not enough bitmap data!" << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+  // Compressed bitmap: runs of pixels are filled at once, black runs only,
+  // as the bitmap is expected to be cleared by the caller.
+  //
+  // Most packed numbers are one or two nybbles long: they are retrieved
+  // through the packed numbers table when starting on a byte boundary, or
+  // directly from the pending nybble otherwise. The other ones (and the
+  // repeat counts) are left to getPackedNumber(). The reading state is kept
+  // in local variables, as the pixels stores could otherwise alias it.
+  bool retrieveCompressed(const RLEBitmap &fromBitmap, Bitmap &toBitmap, const Pos atOffset,
+                          const RLEMetrics &rleMetrics) {
+    uint32_t  width     = fromBitmap.dim.width;
+    uint32_t  height    = fromBitmap.dim.height;
+    uint32_t  toRowSize = toBitmap.rowSize();
+    MemoryPtr toRowPtr  = toBitmap.rowPtr(atOffset.y);
+
+    uint32_t count      = 0;
+    bool     black      = !(rleMetrics.firstIsBlack == 1);
+
+    repeatCount         = 0;
+
+    // dynF is a 4 bits field: 14 is the uncompressed format, 15 is invalid.
+    if (rleMetrics.dynF > 13) return false;
+
+    const uint32_t         dynF        = rleMetrics.dynF;
+    const RLEPackedNumber *table       = rlePackedNumbers.entries[dynF];
+    MemoryPtr              ptr         = memoryPtr;
+    MemoryPtr              end         = memoryEnd;
+    bool                   pending     = false; // Low nybble of pendingByte not read yet
+    uint8_t                pendingByte = 0;
+
+    auto nextPackedNumber = [&](uint32_t &val) -> bool {
+      if (!pending) {
+        if (ptr < end) {
+          const RLEPackedNumber &entry = table[*ptr];
+          if (entry.length == 2) {
+            ptr++;
+            val = entry.value;
+            return true;
+          } else if (entry.length == 1) {
+            pendingByte = *ptr++;
+            pending     = true;
+            val         = entry.value;
+            return true;
+          }
+        }
       } else {
-        toLine[col >> 3] &= fromLine[col >> 3] | ~mask;
+        uint32_t i = pendingByte & 0x0f;
+        if ((i != 0) && (i <= dynF)) {
+          pending = false;
+          val     = i;
+          return true;
+        } else if ((i > dynF) && (i < PK_REPEAT_COUNT) && (ptr < end)) {
+          pendingByte = *ptr++;
+          val         = ((i - dynF - 1) << 4) + (pendingByte >> 4) + dynF + 1;
+          return true;
+        }
+      }
+      memoryPtr     = ptr;
+      nybbleFlipper = pending ? 0x0fU : 0xf0U;
+      nybbleByte    = pendingByte;
+      bool result   = getPackedNumber(val, rleMetrics);
+      ptr           = memoryPtr;
+      pending       = nybbleFlipper == 0x0fU;
+      pendingByte   = nybbleByte;
+      return result;
+    };
+
+    for (uint32_t fromRow = 0; fromRow < height; fromRow++, toRowPtr += toRowSize) {
+      uint32_t toCol = atOffset.x;
+      uint32_t cols  = width;
+      while (cols > 0) {
+        if (count == 0) {
+          if (!nextPackedNumber(count)) return false;
+          black = !black;
+        }
+        uint32_t runLength = (count < cols) ? count : cols;
+        if (black) setBits(toRowPtr, toCol, runLength);
+        toCol += runLength;
+        cols -= runLength;
+        count -= runLength;
       }
-      mask >>= 1;
-      if (mask == 0) mask = 0x80;
+
+      while ((repeatCount > 0) && ((fromRow + 1) < height)) {
+        copyOneRowOneBit(toRowPtr, toRowPtr + toRowSize, atOffset.x, width);
+        repeatCount--;
+        fromRow++;
+        toRowPtr += toRowSize;
+      }
+
+      repeatCount = 0;
     }
+    return true;
   }
 
 public:
   bool retrieveBitmap(const RLEBitmap &fromBitmap, Bitmap &toBitmap, const Pos atOffset,
                       const RLEMetrics rleMetrics) {
     // point on the glyphs' bitmap definition
-    memoryPtr = (MemoryPtr) fromBitmap.pixels.data();
+    memoryPtr = (MemoryPtr) fromBitmap.data();
     memoryEnd = memoryPtr + fromBitmap.length;
-    MemoryPtr toRowPtr;
 
     if ((atOffset.x < 0) || (atOffset.y < 0) ||
         ((atOffset.y + fromBitmap.dim.height) > toBitmap.dim.height) ||
         ((atOffset.x + fromBitmap.dim.width) > toBitmap.dim.width))
       return false;
 
-    if (resolution == PixelResolution::ONE_BIT) {
-      uint32_t toRowSize = (toBitmap.dim.width + 7) >> 3;
-      toRowPtr           = toBitmap.pixels.data() + (atOffset.y * toRowSize);
-
-      if (rleMetrics.dynF == 14) { // is a non-compressed RLE?
-        uint32_t count = 8;
-        uint8_t  data;
-
-        for (uint32_t fromRow = 0; fromRow < fromBitmap.dim.height;
-             fromRow++, toRowPtr += toRowSize) {
-          for (uint32_t toCol = atOffset.x; toCol < fromBitmap.dim.width + atOffset.x; toCol++) {
-            if (count >= 8) {
-              if (!getnext8(data)) {
-                std::cerr << "Not enough bitmap data!" << std::endl;
-                return false;
-              }
-              // std::cout << std::hex << +data << ' ';
-              count = 0;
-            }
-            if (data & (0x80U >> count)) toRowPtr[toCol >> 3] |= (0x80U >> (toCol & 7));
-            count++;
-          }
-        }
-        // std::cout << std::endl;
-      } else {
-        uint32_t count = 0;
-
-        repeatCount   = 0;
-        nybbleFlipper = 0xf0U;
-
-        bool black = !(rleMetrics.firstIsBlack == 1);
-
-        for (uint32_t fromRow = 0; fromRow < fromBitmap.dim.height;
-             fromRow++, toRowPtr += toRowSize) {
-          for (uint32_t toCol = atOffset.x; toCol < fromBitmap.dim.width + atOffset.x; toCol++) {
-            if (count == 0) {
-              if (!getPackedNumber(count, rleMetrics)) { return false; }
-              black = !black;
-              // if (black) {
-              //   std::cout << count << ' ';
-              // }
-              // else {
-              //   std::cout << '(' << count << ')' << ' ';
-              // }
-            }
-            if (black) toRowPtr[toCol >> 3] |= (0x80U >> (toCol & 0x07));
-            count--;
-          }
-
-          // if (repeatCount != 0) std::cout << "Repeat count: " << repeatCount
-          // << std::endl;
-          while ((fromRow < fromBitmap.dim.height) && (repeatCount-- > 0)) {
-            copyOneRowOneBit(toRowPtr, toRowPtr + toRowSize, atOffset.x, fromBitmap.dim.width);
-            fromRow++;
-            toRowPtr += toRowSize;
-          }
-
-          repeatCount = 0;
-        }
-        // std::cout << std::endl;
-      }
+    if (rleMetrics.dynF == 14) { // is a non-compressed RLE?
+      return retrieveUncompressed(fromBitmap, toBitmap, atOffset);
     } else {
-      uint32_t toRowSize = toBitmap.dim.width;
-      toRowPtr           = toBitmap.pixels.data() + (atOffset.y * toRowSize);
-
-      repeatCount   = 0;
-      nybbleFlipper = 0xf0U;
-
-      if (rleMetrics.dynF == 14) { // is a bitmap?
-        uint32_t count = 8;
-        uint8_t  data;
-
-        for (uint32_t fromRow = 0; fromRow < (fromBitmap.dim.height);
-             fromRow++, toRowPtr += toRowSize) {
-          for (uint32_t toCol = atOffset.x; toCol < (fromBitmap.dim.width + atOffset.x); toCol++) {
-            if (count >= 8) {
-              if (!getnext8(data)) {
-                std::cerr << "Not enough bitmap data!" << std::endl;
-                return false;
-              }
-              // std::cout << std::hex << +data << ' ';
-              count = 0;
-            }
-            toRowPtr[toCol] = (data & (0x80U >> count)) ? 0xFF : 0;
-            count++;
-          }
-        }
-        // std::cout << std::endl;
-      } else {
-        uint32_t count = 0;
-
-        repeatCount   = 0;
-        nybbleFlipper = 0xf0U;
-
-        bool black = !(rleMetrics.firstIsBlack == 1);
-
-        for (uint32_t fromRow = 0; fromRow < (fromBitmap.dim.height);
-             fromRow++, toRowPtr += toRowSize) {
-          for (uint32_t toCol = atOffset.x; toCol < (fromBitmap.dim.width + atOffset.x); toCol++) {
-            if (count == 0) {
-              if (!getPackedNumber(count, rleMetrics)) { return false; }
-              black = !black;
-              // if (black) {
-              //   std::cout << count << ' ';
-              // }
-              // else {
-              //   std::cout << '(' << count << ')' << ' ';
-              // }
-            }
-            if (black) toRowPtr[toCol] = 0xFF;
-            count--;
-          }
-
-          // if (repeatCount != 0) std::cout << "Repeat count: " << repeatCount
-          // << std::endl;
-          while ((fromRow < toBitmap.dim.height) && (repeatCount-- > 0)) {
-            copyOneRowEightBits(toRowPtr, toRowPtr + toRowSize, atOffset.x, fromBitmap.dim.width);
-            fromRow++;
-            toRowPtr += toRowSize;
-          }
-
-          repeatCount = 0;
-        }
-        // std::cout << std::endl;
-      }
+      return retrieveCompressed(fromBitmap, toBitmap, atOffset, rleMetrics);
     }
-    return true;
   }
 
 public:
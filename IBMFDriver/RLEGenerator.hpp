@@ -19,6 +19,35 @@ using namespace IBMFDefs;
 #define IS_A_REPEAT_COUNT(c)   (c < 0)
 #define REPEAT_COUNT_IS_ONE(c) (c == -1)
 
+// ----- Encoding tables -----
+
+// Run counts below 209 are sent as two nybbles when dynF is 0. For each of
+// them, the change to apply to the packing size derivative (deriv[index] +=
+// delta) when looking for the best dynF value.
+
+struct RLEDerivStep {
+  uint8_t index;
+  int8_t  delta;
+};
+
+struct RLEDerivTable {
+  RLEDerivStep steps[209];
+};
+
+constexpr auto makeRLEDerivTable() -> RLEDerivTable {
+  RLEDerivTable table{};
+  for (int count = 1; count < 209; count++) {
+    if (count < 14) {
+      table.steps[count] = {.index = static_cast<uint8_t>(count), .delta = -1};
+    } else {
+      table.steps[count] = {.index = static_cast<uint8_t>((223 - count) / 15), .delta = 1};
+    }
+  }
+  return table;
+}
+
+inline constexpr RLEDerivTable rleDerivSteps = makeRLEDerivTable();
+
 class RLEGenerator {
 
 public:
@@ -38,6 +67,11 @@ private:
   uint8_t dynF;         // = 14 if not compressed
   bool    firstIsBlack; // if compressed, true if first nibble contains black pixels
 
+  // Work vectors, kept from one bitmap to the next such that a generator
+  // reused for a whole face does not allocate once it is warmed up.
+  RepeatCounts repeatCounts;
+  Chunks       chunks;
+
 public:
   RLEGenerator() {
     value    = 0;
@@ -125,87 +159,80 @@ public:
   }
 #endif
 
-  void computeChunks(Chunks &chunks, const BitmapPtr bitmap, const RepeatCounts &repeatCounts) {
+  // Runs of pixels are retrieved a word at a time. XOR-ing the pixels of a
+  // word with the same pixels shifted by one gives a bit set at each color
+  // change, found with count-leading-zeros. Repeated rows are skipped.
+  void computeChunks(Chunks &chunks, const Bitmap &bitmap, const RepeatCounts &repeatCounts) {
+    const Bitmap::Word leftmostBit = Bitmap::Word(1) << (Bitmap::WORD_BITS - 1);
+
     chunks.clear();
-    chunks.reserve(50);
-    Chunk   chunk;
-    uint8_t val;
-    if ((val = bitmap->pixels[0]) != 0) chunks.push_back(SET_AS_FIRST_BLACK);
-    chunk            = 1;
-    int  row         = 0;
-    int  col         = 1;
-    int  idx         = 1;
-    bool show_repeat = repeatCounts[row] > 0;
-    while (row < bitmap->dim.height) {
-      while (col < bitmap->dim.width) {
-        if (val == bitmap->pixels[idx++]) {
-          chunk++;
-        } else {
-          chunks.push_back(chunk);
-          if (show_repeat) {
-            show_repeat = false;
+    bool previous = bitmap.getPixel(0, 0); // Color of the pixel preceding the current word
+    if (previous) chunks.push_back(SET_AS_FIRST_BLACK);
+    int chunkStart = 0; // Pixels are numbered from the first one, repeated rows excluded
+    int wordStart  = 0;
+    for (int row = 0; row < bitmap.dim.height; row++) {
+      if (repeatCounts[row] == -1) continue;
+      bool showRepeat = repeatCounts[row] > 0;
+      for (int index = 0; index < bitmap.wordsPerRow; index++) {
+        int          bitCount = bitmap.dim.width - (index * Bitmap::WORD_BITS);
+        Bitmap::Word word     = bitmap.getWord(row, index);
+        if (bitCount > Bitmap::WORD_BITS) bitCount = Bitmap::WORD_BITS;
+        Bitmap::Word changes = (word ^ ((word >> 1) | (previous ? leftmostBit : 0))) &
+                               Bitmap::leftMask(bitCount);
+        previous = ((word >> (Bitmap::WORD_BITS - bitCount)) & 1) != 0;
+        while (changes != 0) {
+          int pos = Bitmap::countLeadingZeros(changes);
+          changes ^= leftmostBit >> pos;
+          chunks.push_back(wordStart + pos - chunkStart);
+          chunkStart = wordStart + pos;
+          if (showRepeat) {
+            showRepeat = false;
             chunks.push_back(SET_AS_REPEAT_COUNT(repeatCounts[row]));
           }
-          val ^= 0xFF;
-          chunk = 1;
         }
-        col++;
+        wordStart += bitCount;
       }
-      row++;
-      col = 0;
-      while ((row < bitmap->dim.height) && (repeatCounts[row] == -1)) {
-        row++;
-        idx += bitmap->dim.width;
-      }
-      show_repeat = repeatCounts[row] > 0;
     }
-    chunks.push_back(chunk);
+    chunks.push_back(wordStart - chunkStart);
   }
 
-  void computeRepeatCounts(const BitmapPtr bitmap, RepeatCounts &repeatCounts) {
-    int     row, col, current;
-    uint8_t val;
-    bool    same;
+  // A row is passed when all its pixels are the same (all white or all
+  // black), else it is compared with the following rows a word at a time.
+  auto rowIsUniform(const Bitmap &bitmap, int row) -> bool {
+    if (bitmap.rowIsEmpty(row)) return true;
+    int lastIndex = bitmap.wordsPerRow - 1;
+    for (int index = 0; index < lastIndex; index++) {
+      if (bitmap.getWord(row, index) != ~Bitmap::Word(0)) return false;
+    }
+    int rest = bitmap.dim.width - (lastIndex * Bitmap::WORD_BITS);
+    return bitmap.getWord(row, lastIndex) == Bitmap::leftMask(rest);
+  }
 
-    repeatCounts.clear();
-    repeatCounts.reserve(bitmap->dim.height);
+  void computeRepeatCounts(const Bitmap &bitmap, RepeatCounts &repeatCounts) {
+    int row, current;
 
-    for (row = 0; row < bitmap->dim.height; row++)
-      repeatCounts.push_back(0);
+    repeatCounts.assign(bitmap.dim.height, 0);
 
     row     = 0;
     current = 1;
-    while (current < bitmap->dim.height) {
-      // Check if all pixels are the same, if so, we pass the row
-      val  = bitmap->pixels[row * bitmap->dim.width];
-      same = true;
-      for (col = 1; col < bitmap->dim.width; col++) {
-        same = val == bitmap->pixels[row * bitmap->dim.width + col];
-        if (!same) break;
-      }
-      if (same) {
+    while (current < bitmap.dim.height) {
+      if (rowIsUniform(bitmap, row)) {
         row++;
         current++;
+      } else if (bitmap.rowsAreEqual(row, current)) {
+        repeatCounts[row]++;
+        repeatCounts[current++] = -1;
       } else {
-        same = true;
-        for (col = 0; col < bitmap->dim.width; col++) {
-          same = bitmap->pixels[row * bitmap->dim.width + col] ==
-                 bitmap->pixels[current * bitmap->dim.width + col];
-          if (!same) break;
-        }
-        if (same) {
-          repeatCounts[row]++;
-          repeatCounts[current++] = -1;
-        } else {
-          row = current;
-          current++;
-        }
+        row = current;
+        current++;
       }
     }
   }
 
   bool encodeBitmap(const BitmapPtr bitmap) {
 
+    clean();
+
     if ((bitmap->dim.height * bitmap->dim.width) == 0) return false;
 
     int compSize = 0;
@@ -215,11 +242,8 @@ public:
 
     // compute compression size and dynF
 
-    RepeatCounts repeatCounts;
-    Chunks       chunks;
-
-    computeRepeatCounts(bitmap, repeatCounts);
-    computeChunks(chunks, bitmap, repeatCounts);
+    computeRepeatCounts(*bitmap, repeatCounts);
+    computeChunks(chunks, *bitmap, repeatCounts);
 
 #if DEBUG
     showRepeatCounts(repeatCounts);
@@ -245,22 +269,18 @@ public:
           compSize += 1;
           count = REPEAT_COUNT(count);
         }
-        if (count < 209)
+        if (count < 209) {
           compSize += 2;
-        else {
+          deriv[rleDerivSteps.steps[count].index] += rleDerivSteps.steps[count].delta;
+        } else {
           int k = count - 193;
           while (k >= 16) {
             k >>= 4;
             compSize += 2;
           }
           compSize += 1;
-        }
-        if (count < 14)
-          deriv[count] -= 1;
-        else if (count < 209)
-          deriv[(223 - count) / 15] += 1;
-        else {
-          int k = 16;
+
+          k = 16;
           while ((k << 4) < (count + 3))
             k <<= 4;
           if ((count - k) <= 192) deriv[(207 - count + k) / 15] += 2;
@@ -340,92 +360,33 @@ public:
 
       // ---- Send bit map (rle uncompressed format) ----
 
-      uint8_t buff       = 0;
-      int     pBit       = 8;
-      int     i          = 1; // index in the chunks list
-      int     rI         = 0;
-      int     sI         = 0;
-      int     hBit       = bitmap->dim.width;
-      bool    on         = false; // true if it's for black pixels
-      bool    rOn        = false;
-      bool    sOn        = false;
-      bool    repeating  = false;     // true if we are repeating previous line
-      int     count      = chunks[0]; // number of bits in the current chunk
-      int     rCount     = 0;
-      int     sCount     = 0;
-      int     repeatFlag = 0;
-
-      while ((i < chunks.size()) || repeating || (count > 0)) {
-        if (repeating) {
-          count = rCount;
-          i     = rI;
-          on    = rOn;
-          repeatFlag -= 1;
-        } else {
-          rCount = count;
-          rI     = i;
-          rOn    = on;
-        }
-
-        // Send one row of bits
-        do {
-          if (count == 0) {
-            if (chunks[i] < 0) {
-              if (!repeating) {
-                repeatFlag = -chunks[i];
-              }
-              i += 1;
-            }
-            count = chunks[i++];
-            on    = !on;
-          }
-          if ((count >= pBit) && (pBit < hBit)) {
-            // we end a byte, we don’t end the row
-            if (on) {
-              buff += (1 << pBit) - 1;
-            }
-            putByte(buff);
-            buff = 0;
-            hBit -= pBit;
-            count -= pBit;
-            pBit = 8;
-          } else if ((count < pBit) && (count < hBit)) {
-            // we end neither the row nor the byte
-            if (on) {
-              buff += (1 << pBit) - (1 << (pBit - count));
-            }
-            pBit -= count;
-            hBit -= count;
-            count = 0;
-          } else {
-            // we end a row and maybe a byte
-            if (on) {
-              buff += (1 << pBit) - (1 << (pBit - hBit));
-            }
-            count -= hBit;
-            pBit -= hBit;
-            hBit = bitmap->dim.width;
+      // All rows, repeated ones included, as a single bit stream. The
+      // pixels are sent by pieces of up to 8 bits, as they fit in the
+      // current byte.
+
+      uint8_t buff = 0;
+      int     pBit = 8; // Free bits in buff
+
+      for (int row = 0; row < bitmap->dim.height; row++) {
+        for (int index = 0; index < bitmap->wordsPerRow; index++) {
+          int          count = bitmap->dim.width - (index * Bitmap::WORD_BITS);
+          Bitmap::Word bits  = bitmap->getWord(row, index);
+          if (count > Bitmap::WORD_BITS) count = Bitmap::WORD_BITS;
+          while (count > 0) {
+            int size = (count < pBit) ? count : pBit;
+            buff |= static_cast<uint8_t>((bits >> (Bitmap::WORD_BITS - size)) << (pBit - size));
+            bits <<= size;
+            count -= size;
+            pBit -= size;
             if (pBit == 0) {
-              putByte(buff);
+              data.push_back(buff);
               buff = 0;
               pBit = 8;
             }
           }
-        } while (hBit != bitmap->dim.width);
-
-        if (repeating && (repeatFlag == 0)) {
-          count     = sCount;
-          i         = sI;
-          on        = sOn;
-          repeating = false;
-        } else if (!repeating && (repeatFlag > 0)) {
-          sCount    = count;
-          sI        = i;
-          sOn       = on;
-          repeating = true;
         }
       }
-      if (pBit != 8) putByte(buff);
+      if (pBit != 8) data.push_back(buff);
     }
 
     return true;
@@ -6,16 +6,16 @@ KerningModel::KerningModel(GlyphCode glyphCode, IBMFDefs::GlyphKernStepsVecPtr g
                            QObject *parent)
     : QAbstractTableModel(parent), glyphCode_(glyphCode), glyphKernSteps_(glyphKernSteps) {
 
-  for (auto entry : *glyphKernSteps_) {
-    addKernEntry(KernEntry(glyphCode_, entry->nextGlyphCode, (float)(entry->kern / 64.0)));
+  for (auto &entry : *glyphKernSteps_) {
+    addKernEntry(KernEntry(glyphCode_, entry.nextGlyphCode, (float)(entry.kern / 64.0)));
   }
 }
 
 void KerningModel::save() {
   glyphKernSteps_->clear();
   for (auto entry : kernEntries_) {
-    glyphKernSteps_->push_back(GlyphKernStepPtr(new GlyphKernStep{
-        .nextGlyphCode = entry.nextGlyphCode, .kern = static_cast<FIX16>(entry.kern * 64.0)}));
+    glyphKernSteps_->push_back(GlyphKernStep{.nextGlyphCode = entry.nextGlyphCode,
+                                             .kern = static_cast<FIX16>(entry.kern * 64.0)});
   }
 }
 
@@ -4,6 +4,8 @@
 
 #include <QPainter>
 
+#include "../glyphAtlas.h"
+
 KerningRenderer::KerningRenderer(QWidget *parent, IBMFFontModPtr font, int faceIdx,
                                  KernEntry *kernEntry)
     : QWidget(parent), font_(font), faceIdx_(faceIdx), kernEntry_(kernEntry) {
@@ -16,8 +18,7 @@ KerningRenderer::KerningRenderer(QWidget *parent, IBMFFontModPtr font, int faceI
   faceHeader_          = font->getFaceHeader(faceIdx);
   glyphsWidth_         = ((faceHeader_->emSize + 32) >> 6) * 3 + 10;
   glyphsHeight_        = faceHeader_->lineHeight + 10;
-  glyphsBitmap_.pixels = Pixels(glyphsWidth_ * glyphsHeight_, 0);
-  glyphsBitmap_.dim    = IBMFDefs::Dim(glyphsWidth_, glyphsHeight_);
+  glyphsBitmap_.setDim(IBMFDefs::Dim(glyphsWidth_, glyphsHeight_));
 
   setMinimumSize(QSize(glyphsWidth_ * PIXEL_SIZE, glyphsHeight_ * PIXEL_SIZE));
 }
@@ -47,20 +48,14 @@ void KerningRenderer::paintEvent(QPaintEvent *event) {
   //            << bitmapOffsetPos_.x() << ", " << bitmapOffsetPos_.y() << "]" << std::endl;
 
   IBMFDefs::Pos atPos(5, glyphsHeight_ - 5 - faceHeader_->descenderHeight);
-  memset(glyphsBitmap_.pixels.data(), 0, glyphsBitmap_.pixels.size());
+  glyphsBitmap_.clearPixels();
 
   int advance = putGlyph(kernEntry_->glyphCode, atPos);
   atPos.x += advance + kernEntry_->kern;
   putGlyph(kernEntry_->nextGlyphCode, atPos);
 
-  int idx = 0;
-  for (int y = 0; y < glyphsHeight_; y++) {
-    for (int x = 0; x < glyphsWidth_; x++, idx++) {
-      if (glyphsBitmap_.pixels[idx] != 0) {
-        setScreenPixel(QPoint(x, y), painter);
-      }
-    }
-  }
+  painter.drawImage(QPoint(-bitmapOffsetPos_.x() * PIXEL_SIZE, -bitmapOffsetPos_.y() * PIXEL_SIZE),
+                    GlyphAtlas::toImage(glyphsBitmap_, PIXEL_SIZE, QColorConstants::DarkGray));
 }
 
 int KerningRenderer::putGlyph(IBMFDefs::GlyphCode code, IBMFDefs::Pos atPos) {
@@ -69,14 +64,8 @@ int KerningRenderer::putGlyph(IBMFDefs::GlyphCode code, IBMFDefs::Pos atPos) {
   font_->getGlyph(faceIdx_, code, glyphInfo, &glyphBitmap);
 
   if (glyphInfo != nullptr) {
-    int outRow = atPos.y - glyphInfo->verticalOffset;
-    for (int inRow = 0; inRow < glyphBitmap->dim.height; inRow++, outRow++) {
-      int outCol = atPos.x - glyphInfo->horizontalOffset;
-      for (int inCol = 0; inCol < glyphBitmap->dim.width; inCol++, outCol++) {
-        uint8_t pixel = glyphBitmap->pixels[inRow * glyphBitmap->dim.width + inCol];
-        if (pixel) glyphsBitmap_.pixels[outRow * glyphsBitmap_.dim.width + outCol] = pixel;
-      }
-    }
+    glyphsBitmap_.merge(*glyphBitmap, atPos.x - glyphInfo->horizontalOffset,
+                        atPos.y - glyphInfo->verticalOffset);
     return (glyphInfo->advance + 32) >> 6;
   } else {
     // std::cout << "Nothing received from font" << std::endl;
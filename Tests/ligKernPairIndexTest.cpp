@@ -0,0 +1,56 @@
+// The lig/kern pairs index under repeated removals and insertions.
+//
+// The steps of the glyphs are removed and inserted again many times, as when
+// a face is edited. The pairs found must be the ones inserted last, and the
+// removed entries must not make the table grow past a few times the pairs
+// in use.
+//
+// Exit code is 0 when the test succeeds.
+
+#include <cstdio>
+
+#include "IBMFDriver/LigKernPairIndex.hpp"
+
+// ----- Helpers -----
+
+static int failures = 0;
+
+static auto check(bool condition, const char *message) -> void {
+  if (!condition) {
+    fprintf(stderr, "FAILED: %s\n", message);
+    failures++;
+  }
+}
+
+// ----- Main -----
+
+int main() {
+  constexpr int GLYPH_COUNT = 100;
+  constexpr int STEP_COUNT  = 10;
+
+  LigKernPairIndex index;
+  bool             same = true;
+
+  for (int round = 0; round < 200; round++) {
+    for (int glyphCode = 0; glyphCode < GLYPH_COUNT; glyphCode++) {
+      for (int k = 0; k < STEP_COUNT; k++) index.remove(glyphCode, round + k - 1);
+      for (int k = 0; k < STEP_COUNT; k++) {
+        index.insert(glyphCode, round + k, static_cast<uint16_t>(round), LigKernPair::KERN);
+      }
+    }
+
+    for (int glyphCode = 0; glyphCode < GLYPH_COUNT; glyphCode++) {
+      same = same && (index.find(glyphCode, round - 1) == nullptr);
+      for (int k = 0; k < STEP_COUNT; k++) {
+        const LigKernPair *pair = index.find(glyphCode, round + k);
+        same = same && (pair != nullptr) && (pair->value == static_cast<uint16_t>(round));
+      }
+    }
+  }
+
+  check(same, "Pairs found after removals and insertions");
+  check(index.capacity() <= (8 * GLYPH_COUNT * STEP_COUNT), "Table size bounded");
+
+  if (failures == 0) printf("ligKernPairIndexTest: OK\n");
+  return (failures == 0) ? 0 : 1;
+}
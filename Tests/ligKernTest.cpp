@@ -0,0 +1,229 @@
+// Lig/kern tables saved and reloaded.
+//
+// - Optical kerning of a whole face. The glyphs are random shapes, such that
+//   most pairs get a kerning and the lig/kern table of the face has to be
+//   trimmed to fit in the font format. A canceled kerning changes nothing.
+//
+// - Pgms relocated through goTos down to index 1, the glyphs without pgm
+//   being left without pgm.
+//
+// - Steps of glyphs edited many times.
+//
+// The kerning steps of the reloaded font must be the ones of the font saved.
+//
+// Exit code is 0 when the test succeeds.
+
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "IBMFDriver/ByteSink.hpp"
+#include "IBMFDriver/IBMFFontMod.hpp"
+
+// ----- Test font -----
+
+// A UTF32 font with a single face, each glyph row being a black run of
+// random position and length.
+
+class TestFont : public IBMFFontMod {
+public:
+  static constexpr int GLYPH_COUNT = 600;
+
+  TestFont(unsigned int seed) {
+    std::mt19937 rng(seed);
+
+    memcpy(preamble_.marker, "IBMF", 4);
+    preamble_.faceCount       = 1;
+    preamble_.bits.version    = IBMF_VERSION;
+    preamble_.bits.fontFormat = FontFormat::UTF32;
+
+    planes_ = {
+        Plane{.codePointBundlesIdx = 0, .entriesCount = 1, .firstGlyphCode = 0},
+        Plane{.codePointBundlesIdx = 1, .entriesCount = 0, .firstGlyphCode = GLYPH_COUNT},
+        Plane{.codePointBundlesIdx = 1, .entriesCount = 0, .firstGlyphCode = GLYPH_COUNT},
+        Plane{.codePointBundlesIdx = 1, .entriesCount = 0, .firstGlyphCode = GLYPH_COUNT}};
+    codePointBundles_ = {
+        CodePointBundle{.firstCodePoint = 0x0021, .lastCodePoint = 0x0021 + GLYPH_COUNT - 1}};
+
+    FacePtr face = FacePtr(new Face);
+    face->header = FaceHeaderPtr(new FaceHeader({
+        .pointSize        = 12,
+        .lineHeight       = 30,
+        .dpi              = 300,
+        .xHeight          = 12 << 6,
+        .emSize           = 24 << 6,
+        .slantCorrection  = 0,
+        .descenderHeight  = 6,
+        .spaceSize        = 6,
+        .glyphCount       = GLYPH_COUNT,
+        .ligKernStepCount = 0, // will be set at save time
+        .pixelsPoolSize   = 0, // will be set at save time
+    }));
+
+    for (int glyphCode = 0; glyphCode < GLYPH_COUNT; glyphCode++) {
+      uint8_t   width  = 4 + (rng() % 16);
+      uint8_t   height = 4 + (rng() % 20);
+      BitmapPtr bitmap = BitmapPtr(new Bitmap(Dim(width, height)));
+      for (int row = 0; row < height; row++) {
+        int first = rng() % width;
+        int last  = first + (rng() % (width - first));
+        for (int col = first; col <= last; col++) bitmap->setPixel(col, row, true);
+      }
+
+      face->glyphs.push_back(GlyphInfo{
+          .bitmapWidth      = width,
+          .bitmapHeight     = height,
+          .horizontalOffset = 0,
+          .verticalOffset   = static_cast<int8_t>(height - 1 - (rng() % 4)),
+          .packetLength     = 0, // will be set at save time
+          .advance          = static_cast<FIX16>((width + 1) << 6),
+          .rleMetrics       = RLEMetrics{.dynF = 0, .firstIsBlack = false, .filler = 0},
+          .ligKernPgmIndex  = 0, // will be set at save time
+          .mainCode         = static_cast<GlyphCode>(glyphCode)});
+      face->bitmaps.push_back(bitmap);
+      face->addGlyphLigKern(GlyphLigKern());
+    }
+    faces_.push_back(std::move(face));
+  }
+
+  // Entries of the face flat lig/kern arrays, in use or not.
+  auto getFlatStepCount() const -> size_t {
+    return faces_[0]->ligSteps.size() + faces_[0]->kernSteps.size();
+  }
+};
+
+// ----- Helpers -----
+
+static int failures = 0;
+
+static auto check(bool condition, const char *message) -> void {
+  if (!condition) {
+    fprintf(stderr, "FAILED: %s\n", message);
+    failures++;
+  }
+}
+
+static auto sameKernSteps(const GlyphLigKern &a, const GlyphLigKern &b) -> bool {
+  if (a.kernSteps.size() != b.kernSteps.size()) return false;
+  for (size_t i = 0; i < a.kernSteps.size(); i++) {
+    if ((a.kernSteps[i].nextGlyphCode != b.kernSteps[i].nextGlyphCode) ||
+        (a.kernSteps[i].kern != b.kernSteps[i].kern)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static auto saveTestFont(std::vector<uint8_t> &data) -> void {
+  TestFont       font(5);
+  VectorByteSink out(data);
+  check(font.save(out), "Synthetic font saved");
+}
+
+// Saves the font and compares the kerning steps of the reloaded one.
+static auto checkReloaded(IBMFFontMod &font, const char *message) -> uint64_t {
+  std::vector<uint8_t> saved;
+  VectorByteSink       out(saved);
+  check(font.save(out), "Font saved");
+
+  IBMFFontMod reloaded(saved.data(), saved.size());
+  check(reloaded.isInitialized(), "Font reloaded");
+  if (!reloaded.isInitialized()) return 0;
+
+  int      mismatchCount = 0;
+  uint64_t stepCount     = 0;
+  for (int glyphCode = 0; glyphCode < TestFont::GLYPH_COUNT; glyphCode++) {
+    GlyphLigKernPtr expected, actual;
+    font.getGlyphLigKern(0, glyphCode, &expected);
+    reloaded.getGlyphLigKern(0, glyphCode, &actual);
+    if (!sameKernSteps(*expected, *actual)) mismatchCount++;
+    stepCount += actual->kernSteps.size();
+  }
+  check(mismatchCount == 0, message);
+  return stepCount;
+}
+
+// ----- Main -----
+
+int main() {
+  std::vector<uint8_t> data;
+  saveTestFont(data);
+
+  // Optical kerning
+
+  {
+    IBMFFontMod font(data.data(), data.size());
+    check(font.isInitialized(), "Synthetic font loaded");
+
+    std::vector<GlyphCode> glyphCodes;
+    for (int glyphCode = 0; glyphCode < TestFont::GLYPH_COUNT; glyphCode++) {
+      glyphCodes.push_back(glyphCode);
+    }
+    IBMFFontMod::AutoKerningProgress canceledProgress;
+    canceledProgress.canceled = true;
+    IBMFFontMod::AutoKerning canceled = font.prepareAutoKerning(glyphCodes, 0, &canceledProgress);
+    check(canceled.glyphLigKerns.empty() && (canceled.stats.kernStepCount == 0),
+          "Canceled kerning empty");
+
+    IBMFFontMod::AutoKerningProgress progress;
+    IBMFFontMod::AutoKerning         kerning = font.prepareAutoKerning(glyphCodes, 0, &progress);
+    check((progress.firstGlyphCount == TestFont::GLYPH_COUNT) &&
+              (progress.doneFirstGlyphCount == progress.firstGlyphCount),
+          "Kerning progress complete");
+
+    IBMFFontMod::AutoKerningStats stats = font.applyAutoKerning(kerning);
+    check(stats.kernStepCount > 0, "Kerning steps generated");
+    check(stats.droppedKernStepCount > 0, "Kerning steps trimmed to fit");
+
+    uint64_t stepCount = checkReloaded(font, "Generated kerning steps reloaded");
+    check(stepCount == stats.kernStepCount, "Generated kerning steps count");
+  }
+
+  // Relocated pgms: glyph 0 gets a single step, such that the next pgm
+  // starts at index 1, followed by as many two steps pgms as can be
+  // relocated. The other glyphs have no pgm.
+
+  {
+    IBMFFontMod font(data.data(), data.size());
+
+    GlyphLigKern glyphLigKern;
+    glyphLigKern.kernSteps = {GlyphKernStep{.nextGlyphCode = 1, .kern = -64}};
+    check(font.setGlyphLigKern(0, 0, glyphLigKern), "Single step pgm set");
+    for (int glyphCode = 1; glyphCode <= 254; glyphCode++) {
+      glyphLigKern.kernSteps = {
+          GlyphKernStep{.nextGlyphCode = static_cast<GlyphCode>(glyphCode), .kern = -64},
+          GlyphKernStep{.nextGlyphCode = static_cast<GlyphCode>(glyphCode + 1), .kern = -128}};
+      check(font.setGlyphLigKern(0, glyphCode, glyphLigKern), "Two steps pgm set");
+    }
+
+    checkReloaded(font, "Relocated pgms reloaded");
+  }
+
+  // Repeated edits of the steps of the glyphs, growing them such that they
+  // can't be updated in place. The flat arrays must not grow with them.
+
+  {
+    TestFont     font(5);
+    GlyphLigKern glyphLigKern;
+    bool         same = true;
+    for (int round = 1; round <= 50; round++) {
+      for (int glyphCode = 0; glyphCode < 100; glyphCode++) {
+        glyphLigKern.kernSteps.clear();
+        for (int k = 0; k < (round + glyphCode) % 20; k++) {
+          glyphLigKern.kernSteps.push_back(GlyphKernStep{
+              .nextGlyphCode = static_cast<GlyphCode>(k), .kern = static_cast<FIX16>(-round)});
+        }
+        font.setGlyphLigKern(0, glyphCode, glyphLigKern);
+        GlyphLigKernPtr actual;
+        font.getGlyphLigKern(0, glyphCode, &actual);
+        same = same && sameKernSteps(glyphLigKern, *actual);
+      }
+    }
+    check(same, "Edited kerning steps");
+    check(font.getFlatStepCount() < (2 * 100 * 20), "Flat arrays compacted");
+    checkReloaded(font, "Edited kerning steps reloaded");
+  }
+
+  if (failures == 0) printf("ligKernTest: OK\n");
+  return (failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,78 @@
+// The parallelFor() worker pool.
+//
+// The tests use a pool of their own, as the hardware may have a single
+// thread, in which case parallelFor() runs everything inline. Every index of
+// a range must be processed exactly once, nested calls must run inline in the
+// calling chunk, and an exception thrown by a chunk must be rethrown to the
+// caller.
+//
+// Exit code is 0 when the test succeeds.
+
+#include <atomic>
+#include <cstdio>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "IBMFDriver/ParallelFor.hpp"
+
+// ----- Helpers -----
+
+static int failures = 0;
+
+static auto check(bool condition, const char *message) -> void {
+  if (!condition) {
+    fprintf(stderr, "FAILED: %s\n", message);
+    failures++;
+  }
+}
+
+// ----- Main -----
+
+int main() {
+  ParallelForPool pool(4);
+
+  // Coverage, repeated such that the pool is reused
+  for (int i = 0; i < 100; i++) {
+    std::vector<std::atomic<int>> counts(1000 + i);
+    pool.forEachChunk(3, counts.size(), 7, [&](size_t first, size_t last) {
+      for (size_t j = first; j < last; j++) counts[j]++;
+    });
+    bool ok = true;
+    for (size_t j = 0; j < counts.size(); j++) ok = ok && (counts[j] == ((j < 3) ? 0 : 1));
+    check(ok, "Each index processed once");
+  }
+
+  // Nested calls run in the thread of the outer chunk
+  std::atomic<int>  total{0};
+  std::atomic<bool> sameThread{true};
+  pool.forEachChunk(0, 64, 1, [&](size_t first, size_t last) {
+    for (size_t i = first; i < last; i++) {
+      std::thread::id outer = std::this_thread::get_id();
+      pool.forEachChunk(0, 1000, 10, [&](size_t innerFirst, size_t innerLast) {
+        if (std::this_thread::get_id() != outer) sameThread = false;
+        total += static_cast<int>(innerLast - innerFirst);
+      });
+    }
+  });
+  check(total == 64 * 1000, "Nested ranges processed");
+  check(sameThread, "Nested calls run inline");
+
+  // Exceptions
+  bool caught = false;
+  try {
+    pool.forEachChunk(0, 1000, 1, [&](size_t first, size_t last) {
+      if ((first <= 500) && (500 < last)) throw std::runtime_error("chunk failed");
+    });
+  } catch (const std::runtime_error &) {
+    caught = true;
+  }
+  check(caught, "Chunk exception rethrown");
+
+  std::atomic<int> count{0};
+  pool.forEachChunk(0, 100, 1, [&](size_t first, size_t last) { count += int(last - first); });
+  check(count == 100, "Pool usable after an exception");
+
+  if (failures == 0) printf("parallelForTest: OK\n");
+  return (failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,70 @@
+// Decoding of RLE bitmaps, well formed and malformed.
+//
+// Bitmaps are encoded with the generator and decoded back with the
+// extractor. Glyphs with an invalid dynF must be rejected, without reading
+// past the decoding tables.
+//
+// Exit code is 0 when the test succeeds.
+
+#include <cstdio>
+#include <random>
+
+#include "IBMFDriver/RLEExtractor.hpp"
+#include "IBMFDriver/RLEGenerator.hpp"
+
+// ----- Helpers -----
+
+static int failures = 0;
+
+static auto check(bool condition, const char *message) -> void {
+  if (!condition) {
+    fprintf(stderr, "FAILED: %s\n", message);
+    failures++;
+  }
+}
+
+static auto decode(const RLEGenerator::Data &data, Dim dim, RLEMetrics rleMetrics,
+                   Bitmap &bitmap) -> bool {
+  RLEBitmap rleBitmap;
+  rleBitmap.pixels = data;
+  rleBitmap.dim    = dim;
+  rleBitmap.length = static_cast<uint16_t>(data.size());
+  bitmap.setDim(dim);
+
+  RLEExtractor extractor;
+  return extractor.retrieveBitmap(rleBitmap, bitmap, Pos(0, 0), rleMetrics);
+}
+
+// ----- Main -----
+
+int main() {
+  std::mt19937 rng(11);
+
+  for (int i = 0; i < 200; i++) {
+    Dim       dim(1 + (rng() % 40), 1 + (rng() % 40));
+    BitmapPtr bitmap = BitmapPtr(new Bitmap(dim));
+    int       ratio  = 2 + (i % 5);
+    for (int row = 0; row < dim.height; row++) {
+      for (int col = 0; col < dim.width; col++) bitmap->setPixel(col, row, (rng() % ratio) == 0);
+    }
+
+    RLEGenerator generator;
+    check(generator.encodeBitmap(bitmap), "Bitmap encoded");
+    RLEGenerator::Data data = *generator.getData();
+    RLEMetrics         rleMetrics{.dynF         = generator.getDynF(),
+                                  .firstIsBlack = generator.getFirstIsBlack(),
+                                  .filler       = 0};
+
+    Bitmap decoded;
+    check(decode(data, dim, rleMetrics, decoded), "Bitmap decoded");
+    check(decoded == *bitmap, "Decoded bitmap matches");
+
+    // dynF 15 is not a valid packing
+    RLEMetrics badMetrics = rleMetrics;
+    badMetrics.dynF       = 15;
+    check(!decode(data, dim, badMetrics, decoded), "Bitmap with dynF 15 rejected");
+  }
+
+  if (failures == 0) printf("rleExtractorTest: OK\n");
+  return (failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,212 @@
+// Saving a font loaded in place back to the file it was loaded from.
+//
+// The font file is memory-mapped (privately, as done by the editor) and the
+// font used in place. A glyph is modified, then the font is saved twice over
+// the same file, truncating it each time. The saved file must hold the
+// original glyphs of all faces plus the modified one.
+//
+// Exit code is 0 when the test succeeds.
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "IBMFDriver/ByteSink.hpp"
+#include "IBMFDriver/IBMFFontMod.hpp"
+
+// ----- Test font -----
+
+// A UTF32 font with random glyph bitmaps, a few faces being left unmodified
+// by the test.
+
+class TestFont : public IBMFFontMod {
+public:
+  static constexpr int FACE_COUNT  = 3;
+  static constexpr int GLYPH_COUNT = 200;
+
+  TestFont(unsigned int seed) {
+    std::mt19937 rng(seed);
+
+    memcpy(preamble_.marker, "IBMF", 4);
+    preamble_.faceCount       = FACE_COUNT;
+    preamble_.bits.version    = IBMF_VERSION;
+    preamble_.bits.fontFormat = FontFormat::UTF32;
+
+    planes_ = {
+        Plane{.codePointBundlesIdx = 0, .entriesCount = 1, .firstGlyphCode = 0},
+        Plane{.codePointBundlesIdx = 1, .entriesCount = 0, .firstGlyphCode = GLYPH_COUNT},
+        Plane{.codePointBundlesIdx = 1, .entriesCount = 0, .firstGlyphCode = GLYPH_COUNT},
+        Plane{.codePointBundlesIdx = 1, .entriesCount = 0, .firstGlyphCode = GLYPH_COUNT}};
+    codePointBundles_ = {
+        CodePointBundle{.firstCodePoint = 0x0021, .lastCodePoint = 0x0021 + GLYPH_COUNT - 1}};
+
+    for (int faceIdx = 0; faceIdx < FACE_COUNT; faceIdx++) {
+      FacePtr face = FacePtr(new Face);
+      face->header = FaceHeaderPtr(new FaceHeader({
+          .pointSize        = static_cast<uint8_t>(10 + (faceIdx * 2)),
+          .lineHeight       = 30,
+          .dpi              = 300,
+          .xHeight          = 12 << 6,
+          .emSize           = 24 << 6,
+          .slantCorrection  = 0,
+          .descenderHeight  = 6,
+          .spaceSize        = 6,
+          .glyphCount       = GLYPH_COUNT,
+          .ligKernStepCount = 0, // will be set at save time
+          .pixelsPoolSize   = 0, // will be set at save time
+      }));
+
+      for (int glyphCode = 0; glyphCode < GLYPH_COUNT; glyphCode++) {
+        uint8_t   width  = 1 + (rng() % 20);
+        uint8_t   height = 1 + (rng() % 24);
+        BitmapPtr bitmap = BitmapPtr(new Bitmap(Dim(width, height)));
+        for (int row = 0; row < height; row++) {
+          for (int col = 0; col < width; col++) bitmap->setPixel(col, row, (rng() % 3) != 0);
+        }
+
+        face->glyphs.push_back(GlyphInfo{
+            .bitmapWidth      = width,
+            .bitmapHeight     = height,
+            .horizontalOffset = 0,
+            .verticalOffset   = static_cast<int8_t>(height - 1),
+            .packetLength     = 0, // will be set at save time
+            .advance          = static_cast<FIX16>((width + 1) << 6),
+            .rleMetrics       = RLEMetrics{.dynF = 0, .firstIsBlack = false, .filler = 0},
+            .ligKernPgmIndex  = 0, // will be set at save time
+            .mainCode         = static_cast<GlyphCode>(glyphCode)});
+        face->bitmaps.push_back(bitmap);
+        face->addGlyphLigKern(GlyphLigKern());
+      }
+      faces_.push_back(std::move(face));
+    }
+  }
+};
+
+// ----- Helpers -----
+
+static int failures = 0;
+
+static auto check(bool condition, const char *message) -> void {
+  if (!condition) {
+    fprintf(stderr, "FAILED: %s\n", message);
+    failures++;
+  }
+}
+
+static auto writeFile(const std::string &path, const std::vector<uint8_t> &data) -> bool {
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  out.write(reinterpret_cast<const char *>(data.data()), data.size());
+  return out.good();
+}
+
+// The file content, privately mapped as the editor does
+static auto mapFile(const std::string &path, uint32_t &size) -> std::shared_ptr<uint8_t> {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) return nullptr;
+  struct stat st;
+  fstat(fd, &st);
+  size        = st.st_size;
+  void *data  = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) return nullptr;
+  return std::shared_ptr<uint8_t>(static_cast<uint8_t *>(data),
+                                  [size](uint8_t *ptr) { munmap(ptr, size); });
+}
+
+static auto getBitmaps(const IBMFFontMod &font) -> std::vector<std::vector<Bitmap>> {
+  std::vector<std::vector<Bitmap>> bitmaps(font.getPreamble().faceCount);
+  for (int faceIdx = 0; faceIdx < font.getPreamble().faceCount; faceIdx++) {
+    for (int glyphCode = 0; glyphCode < font.getFaceHeader(faceIdx)->glyphCount; glyphCode++) {
+      GlyphInfoPtr glyphInfo;
+      BitmapPtr    bitmap;
+      if (font.getGlyph(faceIdx, glyphCode, glyphInfo, &bitmap)) {
+        bitmaps[faceIdx].push_back(*bitmap);
+      }
+    }
+  }
+  return bitmaps;
+}
+
+// ----- Main -----
+
+int main() {
+  char pathTemplate[] = "/tmp/ibmfSaveInPlaceXXXXXX";
+  int  fd             = mkstemp(pathTemplate);
+  if (fd < 0) {
+    fprintf(stderr, "Unable to create a temporary file\n");
+    return 1;
+  }
+  close(fd);
+  std::string path = pathTemplate;
+
+  std::vector<uint8_t> data;
+  {
+    TestFont       font(7);
+    VectorByteSink out(data);
+    check(font.save(out), "Synthetic font saved");
+  }
+  check(writeFile(path, data), "Synthetic font written");
+
+  std::vector<std::vector<Bitmap>> expected;
+  {
+    IBMFFontMod font(data.data(), data.size());
+    check(font.isInitialized(), "Synthetic font loaded");
+    expected = getBitmaps(font);
+  }
+
+  uint32_t                 size;
+  std::shared_ptr<uint8_t> memory = mapFile(path, size);
+  check(memory != nullptr, "Font file mapped");
+  if (memory == nullptr) return 1;
+
+  IBMFFontMod font(memory, size);
+  memory.reset();
+  check(font.isInitialized() && font.isInPlace(), "Font loaded in place");
+
+  // One glyph of the first face is replaced by a large checkerboard, which
+  // grows the face such that the next faces move in the file. The other faces
+  // stay unmodified.
+  GlyphInfoPtr glyphInfo;
+  BitmapPtr    bitmap;
+  check(font.getGlyph(0, 10, glyphInfo, &bitmap), "Glyph retrieved");
+  BitmapPtr board = BitmapPtr(new Bitmap(Dim(40, 40)));
+  for (int row = 0; row < 40; row++) {
+    for (int col = 0; col < 40; col++) board->setPixel(col, row, ((row + col) & 1) != 0);
+  }
+  GlyphInfo newGlyphInfo    = *glyphInfo;
+  newGlyphInfo.bitmapWidth  = 40;
+  newGlyphInfo.bitmapHeight = 40;
+  check(font.saveGlyph(0, 10, &newGlyphInfo, board), "Glyph modified");
+  expected[0][10] = *board;
+
+  // Saved twice over the file it was loaded from, as done by the editor
+  for (int i = 0; i < 2; i++) {
+    std::vector<uint8_t> saved;
+    VectorByteSink       out(saved);
+    check(font.save(out), "Font saved");
+    if (font.isInPlace()) font.detachMemory();
+    check(writeFile(path, saved), "Font written over its file");
+  }
+  check(getBitmaps(font) == expected, "Glyphs of the saved font in memory");
+
+  memory = mapFile(path, size);
+  check(memory != nullptr, "Saved font file mapped");
+  if (memory != nullptr) {
+    IBMFFontMod reloaded(memory, size);
+    check(reloaded.isInitialized(), "Saved font reloaded");
+    check(getBitmaps(reloaded) == expected, "Glyphs of the reloaded font");
+  }
+
+  unlink(path.c_str());
+
+  if (failures == 0) printf("saveInPlaceTest: OK\n");
+  return (failures == 0) ? 0 : 1;
+}
@@ -1,7 +1,7 @@
 #pragma once
 
-#include <QList>
-#include <QString>
+#include <set>
+#include <vector>
 
 struct CodePointBlock {
   int blockIdx_;
@@ -12,7 +12,7 @@ struct CodePointBlock {
 typedef std::vector<CodePointBlock *> CodePointBlocks;
 typedef CodePointBlocks              *CodePointBlocksPtr;
 
-typedef QSet<int>             SelectedBlockIndexes;
+typedef std::set<int>         SelectedBlockIndexes;
 typedef SelectedBlockIndexes *SelectedBlockIndexesPtr;
 
 //----
@@ -2,6 +2,7 @@
 
 #include <QMessageBox>
 
+#include "glyphAtlas.h"
 #include "qwidget.h"
 #include "setPixelCommand.h"
 
@@ -10,10 +11,12 @@ BitmapRenderer::BitmapRenderer(QWidget *parent, int pixelSize, bool noScroll,
     : QWidget(parent), undoStack_(undoStack_), bitmapChanged_(false), glyphPresent_(false),
       pixelSize_(pixelSize), wasBlack_(true), editable_(true), noScroll_(noScroll),
       lastPos_(QPoint(0, 0)), bitmapOffsetPos_(QPoint(0, 0)), glyphBitmapPos_(QPoint(0, 0)),
-      glyphOriginPos_(QPoint(0, 0)) {
+      glyphOriginPos_(QPoint(0, 0)), blackCount_(0), bitmapImageValid_(false) {
   setBackgroundRole(QPalette::Base);
   setAutoFillBackground(true);
-  clearBitmap();
+  displayBitmap_.setDim(IBMFDefs::Dim(bitmapWidth, bitmapHeight));
+  rowBlackCounts_.fill(0);
+  colBlackCounts_.fill(0);
 }
 
 void BitmapRenderer::resizeEvent(QResizeEvent *event) {
@@ -38,7 +41,44 @@ void BitmapRenderer::connectTo(BitmapRenderer *main_renderer) {
 }
 
 void BitmapRenderer::clearBitmap() {
-  memset(displayBitmap_, PixelType::WHITE, sizeof(displayBitmap_));
+  displayBitmap_.clearPixels();
+  rowBlackCounts_.fill(0);
+  colBlackCounts_.fill(0);
+  blackCount_       = 0;
+  bitmapImageValid_ = false;
+}
+
+// Accounts for a pixel of displayBitmap_ that became black or white. The bounds
+// of the black pixels grow at once. When they shrink, they are moved inward to
+// the next row or column still having black pixels, which is bounded by the
+// glyph size.
+void BitmapRenderer::countPixel(int col, int row, bool black) {
+  if (black) {
+    rowBlackCounts_[row]++;
+    colBlackCounts_[col]++;
+    if (blackCount_++ == 0) {
+      blackTopLeft_     = QPoint(col, row);
+      blackBottomRight_ = QPoint(col, row);
+    } else {
+      blackTopLeft_ =
+          QPoint(std::min(blackTopLeft_.x(), col), std::min(blackTopLeft_.y(), row));
+      blackBottomRight_ =
+          QPoint(std::max(blackBottomRight_.x(), col), std::max(blackBottomRight_.y(), row));
+    }
+  } else {
+    rowBlackCounts_[row]--;
+    colBlackCounts_[col]--;
+    if (--blackCount_ == 0) return;
+
+    int left = blackTopLeft_.x(), top = blackTopLeft_.y();
+    int right = blackBottomRight_.x(), bottom = blackBottomRight_.y();
+    while (rowBlackCounts_[top] == 0) top++;
+    while (rowBlackCounts_[bottom] == 0) bottom--;
+    while (colBlackCounts_[left] == 0) left++;
+    while (colBlackCounts_[right] == 0) right--;
+    blackTopLeft_     = QPoint(left, top);
+    blackBottomRight_ = QPoint(right, bottom);
+  }
 }
 
 void BitmapRenderer::clearAndRepaint() {
@@ -73,47 +113,78 @@ void BitmapRenderer::setBitmapOffsetPos(QPoint pos) {
   }
 }
 
-// Put a pixel on screen. The pixel will be sized according to *pixelSize_* value
-// and if the renderer is the main editable or not
-void BitmapRenderer::setScreenPixel(QPoint pos) {
-  QPainter painter(this);
-  QRect    rect;
+void BitmapRenderer::setAdvance(IBMFDefs::FIX16 newAdvance) {
+  glyphInfo_.advance = newAdvance;
+  update();
+}
+
+// The grid lines are drawn by tiling a single cell. Lines are at each multiple
+// of the pixel size, the first row and column of the widget being left blank.
+void BitmapRenderer::drawGrid(QPainter &painter, const QRect &rect) {
+  if (gridPixmap_.width() != pixelSize_) {
+    gridPixmap_ = QPixmap(pixelSize_, pixelSize_);
+    gridPixmap_.fill(Qt::transparent);
+    QPainter cellPainter(&gridPixmap_);
+    cellPainter.setPen(QPen(QBrush(QColorConstants::LightGray), 1));
+    cellPainter.drawLine(QPoint(0, 0), QPoint(pixelSize_ - 1, 0));
+    cellPainter.drawLine(QPoint(0, 0), QPoint(0, pixelSize_ - 1));
+  }
+
+  QRect target = rect.intersected(QRect(1, 1, width() - 1, height() - 1));
+  if (!target.isEmpty()) {
+    painter.drawTiledPixmap(target, gridPixmap_,
+                            QPoint(target.x() % pixelSize_, target.y() % pixelSize_));
+  }
+}
 
-  painter.setPen(QPen(QBrush(QColorConstants::DarkGray), 1));
-  painter.setBrush(QBrush(QColorConstants::DarkGray));
+// Only the glyph pixels inside rect are drawn. The editable renderer draws
+// them all at once as rectangles leaving space for the grid lines. The others
+// draw the part of displayBitmap_ in view as an image, scaled without
+// smoothing.
+void BitmapRenderer::drawPixels(QPainter &painter, const QRect &rect) {
+  int firstCol = bitmapOffsetPos_.x() + (rect.left() / pixelSize_);
+  int firstRow = bitmapOffsetPos_.y() + (rect.top() / pixelSize_);
+  int lastCol  = std::min(bitmapWidth - 1, bitmapOffsetPos_.x() + (rect.right() / pixelSize_));
+  int lastRow  = std::min(bitmapHeight - 1, bitmapOffsetPos_.y() + (rect.bottom() / pixelSize_));
+  if ((firstCol > lastCol) || (firstRow > lastRow)) return;
 
   if (editable_) {
-    // Leave some space for grid lines
-    rect = QRect((pos.x() - bitmapOffsetPos_.x()) * pixelSize_ + 2,
-                 (pos.y() - bitmapOffsetPos_.y()) * pixelSize_ + 2, pixelSize_ - 4, pixelSize_ - 4);
+    QVector<QRect> rects;
+    for (int row = firstRow; row <= lastRow; row++) {
+      if (displayBitmap_.rowIsEmpty(row)) continue;
+      for (int col = firstCol; col <= lastCol; col++) {
+        if (displayBitmap_.getPixel(col, row)) {
+          rects.append(QRect((col - bitmapOffsetPos_.x()) * pixelSize_ + 2,
+                             (row - bitmapOffsetPos_.y()) * pixelSize_ + 2, pixelSize_ - 4,
+                             pixelSize_ - 4));
+        }
+      }
+    }
+    painter.setPen(QPen(QBrush(QColorConstants::DarkGray), 1));
+    painter.setBrush(QBrush(QColorConstants::DarkGray));
+    painter.drawRects(rects);
   } else {
-    rect = QRect((pos.x() - bitmapOffsetPos_.x()) * pixelSize_,
-                 (pos.y() - bitmapOffsetPos_.y()) * pixelSize_, pixelSize_, pixelSize_);
+    if (!bitmapImageValid_) {
+      bitmapImage_      = GlyphAtlas::toImage(displayBitmap_, 1, QColorConstants::DarkGray);
+      bitmapImageValid_ = true;
+    }
+    int colCount = lastCol - firstCol + 1;
+    int rowCount = lastRow - firstRow + 1;
+    painter.setRenderHint(QPainter::SmoothPixmapTransform, false);
+    painter.drawImage(QRect((firstCol - bitmapOffsetPos_.x()) * pixelSize_,
+                            (firstRow - bitmapOffsetPos_.y()) * pixelSize_, colCount * pixelSize_,
+                            rowCount * pixelSize_),
+                      bitmapImage_, QRect(firstCol, firstRow, colCount, rowCount));
   }
-  painter.drawRect(rect);
-}
-
-void BitmapRenderer::setAdvance(IBMFDefs::FIX16 newAdvance) {
-  glyphInfo_.advance = newAdvance;
-  update();
 }
 
 // The event will paint the grid lines, the limiting lines and the pixels that are part
-// of the glyph
-void BitmapRenderer::paintEvent(QPaintEvent * /* event */) {
+// of the glyph, all with the same painter
+void BitmapRenderer::paintEvent(QPaintEvent *event) {
   QPainter painter(this);
 
-  painter.setPen(QPen(QBrush(QColorConstants::LightGray), 1));
-  painter.setBrush(QBrush(QColorConstants::Red));
-
   if (editable_) {
-
-    for (int row = pixelSize_; row < height(); row += pixelSize_) {
-      for (int col = pixelSize_; col < width(); col += pixelSize_) {
-        painter.drawLine(QPoint(col, 0), QPoint(col, height()));
-        painter.drawLine(QPoint(0, row), QPoint(width(), row));
-      }
-    }
+    drawGrid(painter, event->rect());
 
     if (glyphPresent_) {
       int originRow    = (glyphOriginPos_.y() - bitmapOffsetPos_.y() - 1) * pixelSize_;
@@ -134,22 +205,18 @@ void BitmapRenderer::paintEvent(QPaintEvent * /* event */) {
       painter.setPen(QPen(QBrush(QColorConstants::Blue), 1));
       painter.drawLine(QPoint(advCol, descenderRow), QPoint(advCol, topRow));
     }
-
-    painter.setPen(QPen(QBrush(QColorConstants::LightGray), 1));
   }
 
-  int rowp;
-  for (int row = bitmapOffsetPos_.y(), rowp = row * bitmapWidth; row < bitmapHeight;
-       row++, rowp += bitmapWidth) {
-    for (int col = bitmapOffsetPos_.x(); col < bitmapWidth; col++) {
-      if (displayBitmap_[rowp + col] == PixelType::BLACK) { setScreenPixel(QPoint(col, row)); }
-    }
-  }
+  drawPixels(painter, event->rect());
 }
 
 void BitmapRenderer::paintPixel(PixelType pixelType, QPoint atPos) {
-  int idx             = atPos.y() * bitmapWidth + atPos.x();
-  displayBitmap_[idx] = pixelType;
+  bool black = pixelType == PixelType::BLACK;
+  if (displayBitmap_.getPixel(atPos.x(), atPos.y()) != black) {
+    displayBitmap_.setPixel(atPos.x(), atPos.y(), black);
+    countPixel(atPos.x(), atPos.y(), black);
+    bitmapImageValid_ = false;
+  }
 
   IBMFDefs::BitmapPtr theBitmap;
   QPoint              originOffsets;
@@ -167,9 +234,8 @@ void BitmapRenderer::mousePressEvent(QMouseEvent *event) {
     lastPos_ = QPoint(bitmapOffsetPos_.x() + event->pos().x() / pixelSize_,
                       bitmapOffsetPos_.y() + event->pos().y() / pixelSize_);
     if ((lastPos_.x() < bitmapWidth) && (lastPos_.y() < bitmapHeight)) {
-      int       idx = lastPos_.y() * bitmapWidth + lastPos_.x();
       PixelType newPixelType;
-      if (displayBitmap_[idx] == PixelType::BLACK) {
+      if (displayBitmap_.getPixel(lastPos_.x(), lastPos_.y())) {
         newPixelType = PixelType::WHITE;
         wasBlack_    = false;
       } else {
@@ -229,13 +295,16 @@ void BitmapRenderer::loadBitmap(const IBMFDefs::Bitmap &bitmap) {
     return;
   }
 
-  int idx;
-  int rowp;
-  for (int row = glyphBitmapPos_.y(), rowp = row * bitmapWidth, idx = 0;
-       row < glyphBitmapPos_.y() + bitmap.dim.height; row++, rowp += bitmapWidth) {
-    for (int col = glyphBitmapPos_.x(); col < glyphBitmapPos_.x() + bitmap.dim.width;
-         col++, idx++) {
-      displayBitmap_[rowp + col] = (bitmap.pixels[idx] == 0) ? PixelType::WHITE : PixelType::BLACK;
+  // The display bitmap has been cleared: the glyph pixels are merged in it.
+  displayBitmap_.merge(bitmap, glyphBitmapPos_.x(), glyphBitmapPos_.y());
+  bitmapImageValid_ = false;
+
+  int lastRow = std::min(bitmapHeight, glyphBitmapPos_.y() + bitmap.dim.height);
+  int lastCol = std::min(bitmapWidth, glyphBitmapPos_.x() + bitmap.dim.width);
+  for (int row = glyphBitmapPos_.y(); row < lastRow; row++) {
+    if (displayBitmap_.rowIsEmpty(row)) continue;
+    for (int col = glyphBitmapPos_.x(); col < lastCol; col++) {
+      if (displayBitmap_.getPixel(col, row)) countPixel(col, row, true);
     }
   }
 
@@ -245,62 +314,15 @@ void BitmapRenderer::loadBitmap(const IBMFDefs::Bitmap &bitmap) {
 }
 
 bool BitmapRenderer::retrieveBitmap(IBMFDefs::BitmapPtr *bitmap, QPoint *originOffsets) {
-  QPoint topLeft;
-  QPoint bottomRight;
+  // Nothing to retrieve if the bitmap is empty of black pixels
+  if (blackCount_ == 0) return false;
 
-  int row;
-  int col;
-
-  int idx;
-  for (row = 0, idx = 0; row < bitmapHeight; row++) {
-    for (col = 0; col < bitmapWidth; col++, idx++) {
-      if (displayBitmap_[idx] != PixelType::WHITE) goto cont1;
-    }
-  }
-cont1:
-  if (row >= bitmapHeight) return false; // The bitmap is empty of black pixels
+  QPoint topLeft = blackTopLeft_;
 
-  topLeft.setY(row);
-
-  int rowp;
-  for (row = bitmapHeight - 1, rowp = (bitmapHeight - 1) * bitmapWidth; row >= 0;
-       row--, rowp -= bitmapWidth) {
-    for (col = 0; col < bitmapWidth; col++) {
-      if (displayBitmap_[rowp + col] != PixelType::WHITE) goto cont2;
-    }
-  }
-cont2:
-  bottomRight.setY(row);
-
-  for (col = 0; col < bitmapWidth; col++) {
-    for (row = 0, rowp = 0; row < bitmapHeight; row++, rowp += bitmapWidth) {
-      if (displayBitmap_[rowp + col] != PixelType::WHITE) goto cont3;
-    }
-  }
-cont3:
-  topLeft.setX(col);
-
-  for (col = bitmapWidth - 1; col >= 0; col--) {
-    for (row = 0, rowp = 0; row < bitmapHeight; row++, rowp += bitmapWidth) {
-      if (displayBitmap_[rowp + col] != PixelType::WHITE) goto cont4;
-    }
-  }
-cont4:
-  bottomRight.setX(col);
-
-  IBMFDefs::BitmapPtr theBitmap = IBMFDefs::BitmapPtr(new IBMFDefs::Bitmap);
-  theBitmap->dim =
-      IBMFDefs::Dim(bottomRight.x() - topLeft.x() + 1, bottomRight.y() - topLeft.y() + 1);
-  int size          = theBitmap->dim.width * theBitmap->dim.height;
-  theBitmap->pixels = IBMFDefs::Pixels(size, 0);
-
-  idx = 0;
-  for (row = topLeft.y(), rowp = row * bitmapWidth; row <= bottomRight.y();
-       row++, rowp += bitmapWidth) {
-    for (col = topLeft.x(); col <= bottomRight.x(); col++) {
-      theBitmap->pixels[idx++] = displayBitmap_[rowp + col] == PixelType::WHITE ? 0 : 0xff;
-    }
-  }
+  IBMFDefs::BitmapPtr theBitmap = IBMFDefs::BitmapPtr(new IBMFDefs::Bitmap(displayBitmap_.extract(
+      topLeft.x(), topLeft.y(),
+      IBMFDefs::Dim(blackBottomRight_.x() - topLeft.x() + 1,
+                    blackBottomRight_.y() - topLeft.y() + 1))));
 
   if (originOffsets != nullptr) {
     *originOffsets =
@@ -1,9 +1,13 @@
 #pragma once
 
+#include <array>
+
+#include <QImage>
 #include <QMouseEvent>
 #include <QPainter>
 #include <QPainterPath>
 #include <QPen>
+#include <QPixmap>
 #include <QPoint>
 #include <QScrollBar>
 #include <QUndoStack>
@@ -53,19 +57,19 @@ protected:
   void wheelEvent(QWheelEvent *event);
 
 private:
-  void setScreenPixel(QPoint pos);
   void loadBitmap(const IBMFDefs::Bitmap &bitmap);
   void clearBitmap();
+  void countPixel(int col, int row, bool black);
+  void drawGrid(QPainter &painter, const QRect &rect);
+  void drawPixels(QPainter &painter, const QRect &rect);
 
-  typedef PixelType DisplayBitmap[bitmapWidth * bitmapHeight];
-
-  QUndoStack   *undoStack_;     // The master undo stack as received from the main window
-  bool          bitmapChanged_; // True if some pixel modified on screen
-  bool          glyphPresent_;  // True if there is a glyph shown on screen
-  int           pixelSize_;     // How large a glyph pixel will appear on screen
-  DisplayBitmap displayBitmap_; // Each entry correspond to one pixel of a glyph
-  bool          wasBlack_;      // used by mouse events to permit sequence of pixels drawing
-                                // through mouse move
+  QUndoStack      *undoStack_;     // The master undo stack as received from the main window
+  bool             bitmapChanged_; // True if some pixel modified on screen
+  bool             glyphPresent_;  // True if there is a glyph shown on screen
+  int              pixelSize_;     // How large a glyph pixel will appear on screen
+  IBMFDefs::Bitmap displayBitmap_; // Packed, one bit per glyph pixel
+  bool             wasBlack_;      // used by mouse events to permit sequence of pixels drawing
+                                   // through mouse move
   bool editable_;               // Only the main renderer is editable with lines delimiting
                                 // pixels on screen
   bool noScroll_;               // True for all secondary BitmapRenderer. No scroll bar will
@@ -79,6 +83,16 @@ private:
   QPoint glyphOriginPos_;       // Origin position of the glyph bitmap on the
                                 // displayBitmap
 
+  std::array<uint16_t, bitmapHeight> rowBlackCounts_; // Black pixels of each displayBitmap_ row
+  std::array<uint16_t, bitmapWidth>  colBlackCounts_; // and column, kept by countPixel()
+  int    blackCount_;              // Black pixels in displayBitmap_
+  QPoint blackTopLeft_;            // Bounds of the black pixels in displayBitmap_, valid
+  QPoint blackBottomRight_;        // when blackCount_ is not 0
+
+  QPixmap gridPixmap_;           // One grid cell, tiled over the editable renderer
+  QImage  bitmapImage_;          // displayBitmap_ one pixel per glyph pixel, scaled when drawn
+  bool    bitmapImageValid_;     // False when displayBitmap_ changed since bitmapImage_ was built
+
   IBMFDefs::Preamble   preamble_;   // Copies of the font structure related to the current glyph
   IBMFDefs::FaceHeader faceHeader_; // idem
   IBMFDefs::GlyphInfo  glyphInfo_;  // idem
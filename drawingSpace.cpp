@@ -1,8 +1,10 @@
 #include "drawingSpace.h"
 
+#include <algorithm>
 #include <iostream>
 
 #include <QPainter>
+#include <QResizeEvent>
 
 DrawingSpace::DrawingSpace(IBMFFontModPtr font, int faceIdx, QWidget *parent)
     : QWidget{parent}, font_(font), faceIdx_(faceIdx) {
@@ -15,124 +17,71 @@ void DrawingSpace::setBypassGlyph(IBMFDefs::GlyphCode glyphCode, IBMFDefs::Bitma
     bypassGlyphCode_ = glyphCode;
     bypassBitmap_    = bitmap;
     bypassGlyphInfo_ = glyphInfo;
+    bypassImage_     = GlyphAtlas::toImage(*bitmap, pixelSize_, QColorConstants::DarkGray);
+    IBMFFontMod::computeGlyphProfile(*bitmap, bypassProfile_);
   } else {
     bypassGlyphCode_ = NO_GLYPH_CODE;
+    bypassBitmap_    = nullptr;
   }
-  update();
+  invalidateLayout();
 }
 
-auto DrawingSpace::computeAutoKerning(const IBMFDefs::BitmapPtr b1, const IBMFDefs::BitmapPtr b2,
+// The profiles of the glyphs are kept within a budget, as the atlas images.
+auto DrawingSpace::computeAutoKerning(IBMFDefs::GlyphCode g1, const IBMFDefs::BitmapPtr b1,
+                                      IBMFDefs::GlyphCode g2, const IBMFDefs::BitmapPtr b2,
                                       const IBMFDefs::GlyphInfo &i1,
-                                      const IBMFDefs::GlyphInfo &i2) const -> FIX16 {
-  int kerning     = 0;
-
-  int buffWidth   = (font_->getFaceHeader(faceIdx_)->emSize >> 6) * 2;
-  int buffHeight  = font_->getFaceHeader(faceIdx_)->lineHeight * 2;
-
-  uint8_t *buffer = new uint8_t[buffWidth * buffHeight];
-
-  memset(buffer, 0, buffWidth * buffHeight);
-
-  QPoint pos = QPoint(5, (buffHeight / 3) * 2); //  This is the origin
-
-  int voff   = i1.verticalOffset;
-  int hoff   = i1.horizontalOffset;
-
-  int idx    = 0;
-  for (int row = 0; row < b1->dim.height; row++) {
-    for (int col = 0; col < b1->dim.width; col++, idx++) {
-      if (b1->pixels[idx] != 0) {
-        int buffIdx     = ((pos.y() - voff + row) * buffWidth) + (pos.x() - hoff + col);
-        buffer[buffIdx] = 1;
-      }
-    }
-  }
-
-  int advance = ((i1.advance + 32) >> 6);
-  if (advance == 0) advance = i1.bitmapWidth + 1;
-
-  pos.setX(pos.x() + advance);
-
-  int max = advance - 1;
-  while (max > 0) {
-    int voff = i2.verticalOffset;
-    int hoff = i2.horizontalOffset;
-
-    for (int col = 0; col < b2->dim.width; col++) {
-      for (int row = 0; row < b2->dim.height; row++) {
-        if (b2->pixels[row * b2->dim.width + col] != 0) {
-          int buffIdx = ((pos.y() - voff + row) * buffWidth) + (pos.x() - hoff + col);
-          if (buffer[buffIdx] == 1) {
-            buffer[buffIdx] = 2;
-            goto end;
-          } else if (buffer[buffIdx - buffWidth] == 1) {
-            buffer[buffIdx - buffWidth] = 2;
-            goto end;
-          } else if (buffer[buffIdx + buffWidth] == 1) {
-            buffer[buffIdx + buffWidth] = 2;
-            goto end;
-          } else {
-            buffer[buffIdx] = 3;
-          }
-        }
-      }
-    }
-
-    //    std::cout << '+';
-    //    for (int col = 0; col < buffWidth; col++) {
-    //      std::cout << '-';
-    //    }
-    //    std::cout << '+' << std::endl;
-
-    //    for (int row = 0; row < buffHeight; row++) {
-    //      std::cout << '|';
-    //      for (int col = 0; col < buffWidth; col++) {
-    //        int  buffIdx = (row * buffWidth) + col;
-    //        char ch      = ' ';
-    //        if (buffer[buffIdx] == 1) {
-    //          ch = 'X';
-    //        } else if (buffer[buffIdx] == 2) {
-    //          ch = '*';
-    //        } else if (buffer[buffIdx] == 3) {
-    //          ch = '?';
-    //        }
-    //        std::cout << ch;
-    //      }
-    //      std::cout << '|' << std::endl;
-    //    }
-
-    //    std::cout << '+';
-    //    for (int col = 0; col < buffWidth; col++) {
-    //      std::cout << '-';
-    //    }
-    //    std::cout << '+' << std::endl;
+                                      const IBMFDefs::GlyphInfo &i2) -> FIX16 {
+  return IBMFFontMod::computeAutoKerning(glyphProfile(g1, b1), glyphProfile(g2, b2), i1, i2);
+}
 
-    pos.setX(pos.x() - 1);
-    kerning -= 1;
-    max -= 1;
+auto DrawingSpace::glyphProfile(IBMFDefs::GlyphCode glyphCode, const IBMFDefs::BitmapPtr bitmap)
+    -> const IBMFFontMod::GlyphProfile & {
+  if (bitmap == bypassBitmap_) return bypassProfile_;
+
+  IBMFFontMod::GlyphProfile *profile = profiles_.find(glyphCode);
+  if (profile == nullptr) {
+    IBMFFontMod::GlyphProfile computed;
+    IBMFFontMod::computeGlyphProfile(*bitmap, computed);
+    size_t size = sizeof(computed) +
+                  ((computed.left.capacity() + computed.right.capacity()) * sizeof(int16_t));
+    profile = &profiles_.put(glyphCode, std::move(computed), size);
   }
+  return *profile;
+}
 
-end:
-  //
+void DrawingSpace::setFont(IBMFFontModPtr font) {
+  font_        = font;
+  faceIdx_     = 0;
+  layoutValid_ = false;
+  atlas_.clear();
+  profiles_.clear();
+}
 
-  delete[] buffer;
-  return (max > 0) ? ((kerning + KERNING_SIZE + 1) << 6) : 0;
+// To be called when the glyphs or the kerning of the font are modified.
+void DrawingSpace::invalidateLayout() {
+  layoutValid_ = false;
+  update();
 }
 
-void DrawingSpace::setFont(IBMFFontModPtr font) {
-  font_    = font;
-  faceIdx_ = 0;
+void DrawingSpace::glyphChanged(IBMFDefs::GlyphCode glyphCode) {
+  atlas_.erase(glyphCode);
+  profiles_.erase(glyphCode);
+  invalidateLayout();
 }
 
 void DrawingSpace::setFaceIdx(int faceIdx) {
   if ((font_ != nullptr) && (faceIdx < font_->getPreamble().faceCount) && (faceIdx >= 0)) {
     faceIdx_ = faceIdx;
+    atlas_.clear();
+    profiles_.clear();
     computeSize();
   }
 }
 
 void DrawingSpace::setText(QString text) {
   textToDraw_ = text;
+  IBMFFontMod::decodeUTF16(reinterpret_cast<const char16_t *>(text.utf16()), text.size(),
+                           codePoints_);
   computeSize();
 }
 
@@ -148,12 +97,21 @@ void DrawingSpace::setNormalKerning(bool value) {
 
 void DrawingSpace::setPixelSize(int value) {
   pixelSize_ = value;
+  atlas_.setPixelSize(value);
+  if (bypassBitmap_ != nullptr) {
+    bypassImage_ = GlyphAtlas::toImage(*bypassBitmap_, pixelSize_, QColorConstants::DarkGray);
+  }
   computeSize();
 }
 
+void DrawingSpace::resizeEvent(QResizeEvent *event) {
+  if (event->size().width() != event->oldSize().width()) computeSize();
+}
+
 auto DrawingSpace::computeSize() -> void {
+  layoutValid_ = false;
   if ((font_ != nullptr) && (faceIdx_ < font_->getPreamble().faceCount) && (faceIdx_ >= 0)) {
-    drawScreen(nullptr);
+    layout();
     requiredSize_ = QSize(width(), (pos_.y() + font_->getLineHeight(faceIdx_)) * pixelSize_);
     adjustSize();
     update();
@@ -167,9 +125,9 @@ QSize DrawingSpace::sizeHint() const {
   return requiredSize_;
 }
 
-void DrawingSpace::paintWord(QPainter *painter, int lineHeight) {
-
-  QRect rect;
+// The glyphs of the word are placed on the current line, or on the next one
+// if it doesn't fit.
+void DrawingSpace::placeWord(int lineHeight) {
 
   if (((pos_.x() + wordLength_) * pixelSize_ + 20) > this->width()) {
     if ((wordLength_ * pixelSize_ + 20) < this->width()) {
@@ -194,49 +152,72 @@ void DrawingSpace::paintWord(QPainter *painter, int lineHeight) {
       pos_.setX(0);
     }
 
-    if (painter != nullptr) {
-      int idx = 0;
-      if (pixelSize_ == 1) {
-        for (int row = 0; row < ch.bitmap->dim.height; row++) {
-          for (int col = 0; col < ch.bitmap->dim.width; col++, idx++) {
-            if (ch.bitmap->pixels[idx] != 0) {
-              painter->drawPoint(QPoint(10 + (pos_.x() - hoff + col), pos_.y() - voff + row));
-            }
-          }
-        }
-      } else {
-        for (int row = 0; row < ch.bitmap->dim.height; row++) {
-          for (int col = 0; col < ch.bitmap->dim.width; col++, idx++) {
-            if (ch.bitmap->pixels[idx] != 0) {
-              rect = QRect(10 + (pos_.x() - hoff + col) * pixelSize_,
-                           (pos_.y() - voff + row) * pixelSize_, pixelSize_, pixelSize_);
-
-              painter->drawRect(rect);
-            }
-          }
-        }
-      }
+    int top    = pos_.y() - voff;
+    int bottom = top + ch.bitmap->dim.height;
+    if (lines_.empty() || (pos_.y() != lineBaseline_)) {
+      lines_.push_back(Line({.top = top, .bottom = bottom, .firstGlyph = glyphs_.size()}));
+      lineBaseline_ = pos_.y();
+    } else {
+      lines_.back().top    = std::min(lines_.back().top, top);
+      lines_.back().bottom = std::max(lines_.back().bottom, bottom);
     }
 
+    glyphs_.push_back(PlacedGlyph({.glyphCode = ch.glyphCode,
+                                   .bypass    = (ch.bitmap == bypassBitmap_),
+                                   .x         = pos_.x() - hoff,
+                                   .y         = pos_.y() - voff}));
+
     pos_.setX(pos_.x() + advance);
   }
   word_.clear();
   wordLength_ = 0;
 }
 
-void DrawingSpace::drawScreen(QPainter *painter) {
-
-  // std::cout << "drawScreen()..." << std::endl;
+// Only the lines intersecting rect, in screen pixels, are painted.
+void DrawingSpace::drawScreen(QPainter *painter, const QRect &rect) {
 
   if (font_ == nullptr) return;
 
-  word_.clear();
-  wordLength_ = 0;
-
-  if (painter != nullptr) {
-    painter->setPen(QPen(QBrush(QColorConstants::DarkGray), 1));
-    painter->setBrush(QBrush(QColorConstants::DarkGray));
+  if (!layoutValid_) layout();
+
+  int  top    = rect.top() / pixelSize_;
+  int  bottom = rect.bottom() / pixelSize_ + 1;
+
+  auto line   = std::lower_bound(lines_.begin(), lines_.end(), top,
+                                 [](const Line &line, int top) { return line.bottom <= top; });
+
+  // The glyph being edited is not in the atlas, as it changes all the time.
+  // The bitmaps of the glyphs missing in the atlas are retrieved through the
+  // font's bitmap cache.
+  for (; (line != lines_.end()) && (line->top < bottom); line++) {
+    size_t last = ((line + 1) != lines_.end()) ? (line + 1)->firstGlyph : glyphs_.size();
+    for (size_t i = line->firstGlyph; i < last; i++) {
+      const PlacedGlyph &glyph = glyphs_[i];
+      const QImage      *image = glyph.bypass ? &bypassImage_ : atlas_.find(glyph.glyphCode);
+      if (image == nullptr) {
+        IBMFDefs::GlyphInfoPtr glyphInfo;
+        IBMFDefs::BitmapPtr    bitmap;
+        if (!font_->getGlyph(faceIdx_, glyph.glyphCode, glyphInfo, &bitmap)) continue;
+        image = &atlas_.put(glyph.glyphCode, *bitmap);
+      }
+      if (!image->isNull()) {
+        painter->drawImage(QPoint(10 + glyph.x * pixelSize_, glyph.y * pixelSize_), *image);
+      }
+    }
   }
+}
+
+// Glyphs are retrieved, kerned and placed once, until the text, the face, the
+// kerning modes, the pixel size, the width or the glyphs change.
+void DrawingSpace::layout() {
+
+  // std::cout << "layout()..." << std::endl;
+
+  glyphs_.clear();
+  lines_.clear();
+  word_.clear();
+  wordLength_  = 0;
+  layoutValid_ = true;
 
   int lineHeight   = font_->getLineHeight(faceIdx_);
 
@@ -250,14 +231,17 @@ void DrawingSpace::drawScreen(QPainter *painter) {
   IBMFDefs::GlyphInfoPtr i1, i2;
   IBMFDefs::GlyphCode    g1, g2;
 
-  for (auto &ch : textToDraw_) {
+  font_->translate(codePoints_, glyphCodes_);
+
+  for (size_t i = 0; i < codePoints_.size(); i++) {
+    char32_t               ch = codePoints_[i];
     IBMFDefs::BitmapPtr    bitmap;
     IBMFDefs::GlyphInfoPtr glyphInfo;
     IBMFDefs::GlyphCode    glyphCode;
 
     if (ch == '\n') {
       if (word_.size() > 0) {
-        paintWord(painter, lineHeight);
+        placeWord(lineHeight);
       }
       pos_.setY(pos_.y() + lineHeight);
       pos_.setX(0);
@@ -266,7 +250,7 @@ void DrawingSpace::drawScreen(QPainter *painter) {
       continue;
     } else if (ch == ' ') {
       if (word_.size() > 0) {
-        paintWord(painter, lineHeight);
+        placeWord(lineHeight);
         first = true;
       }
       if (!startOfLine) {
@@ -274,7 +258,7 @@ void DrawingSpace::drawScreen(QPainter *painter) {
       }
       continue;
     } else {
-      glyphCode = font_->translate(ch.unicode());
+      glyphCode = glyphCodes_[i];
       // bypassXXX is a glyph currently being edited on screen. If present, it will be
       // taken instead of the same glyphCode present in the font that was still not
       // been updated
@@ -327,7 +311,7 @@ void DrawingSpace::drawScreen(QPainter *painter) {
         }
 
         if ((!kernPairPresent) && opticalKerning_) {
-          kerning = computeAutoKerning(b1, b2, *i1, *i2);
+          kerning = computeAutoKerning(g1, b1, g2, b2, *i1, *i2);
         }
 
         // std::cout << kerning << " " << std::endl;
@@ -343,15 +327,23 @@ void DrawingSpace::drawScreen(QPainter *painter) {
     if (advance == 0) (advance = glyphInfo->bitmapWidth + 1) << 6;
 
     wordLength_ += ((advance + kerning + 32) >> 6); // - glyphInfo->horizontalOffset;
-    word_.push_back(OneGlyph({.bitmap = bitmap, .glyphInfo = glyphInfo, .kern = kerning}));
+    word_.push_back(OneGlyph(
+        {.glyphCode = glyphCode, .bitmap = bitmap, .glyphInfo = glyphInfo, .kern = kerning}));
     startOfLine = false;
   }
 
-  if (word_.size() != 0) paintWord(painter, lineHeight);
+  if (word_.size() != 0) placeWord(lineHeight);
+
+  for (size_t i = 1; i < lines_.size(); i++) {
+    lines_[i].bottom = std::max(lines_[i].bottom, lines_[i - 1].bottom);
+  }
+  for (size_t i = lines_.size(); i-- > 1;) {
+    lines_[i - 1].top = std::min(lines_[i - 1].top, lines_[i].top);
+  }
 }
 
 void DrawingSpace::paintEvent(QPaintEvent *event) {
   if (font_ == nullptr) return;
   QPainter painter(this);
-  drawScreen(&painter);
+  drawScreen(&painter, event->rect());
 }
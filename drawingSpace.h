@@ -5,15 +5,15 @@
 #include <QWidget>
 
 #include "IBMFDriver/IBMFFontMod.hpp"
+#include "glyphAtlas.h"
 
 #define AUTO_KERNING 0
-#define KERNING_SIZE 1
 
 class DrawingSpace : public QWidget {
   Q_OBJECT
 public:
   explicit DrawingSpace(IBMFFontModPtr font = nullptr, int faceIdx = 0, QWidget *parent = nullptr);
-  void drawScreen(QPainter *painter);
+  void drawScreen(QPainter *painter, const QRect &rect);
 
   void setText(QString text);
   void setAutoKerning(bool value);
@@ -23,24 +23,59 @@ public:
   void setFaceIdx(int faceIdx);
   void setBypassGlyph(IBMFDefs::GlyphCode glyphCode, IBMFDefs::BitmapPtr bitmap,
                       IBMFDefs::GlyphInfoPtr glyphInfo);
+  void invalidateLayout();
+  void glyphChanged(IBMFDefs::GlyphCode glyphCode);
 
 signals:
 
 protected:
   void  paintEvent(QPaintEvent *event) override;
+  void  resizeEvent(QResizeEvent *event) override;
   QSize sizeHint() const override;
 
 private:
   struct OneGlyph {
+    IBMFDefs::GlyphCode    glyphCode;
     IBMFDefs::BitmapPtr    bitmap;
     IBMFDefs::GlyphInfoPtr glyphInfo;
     FIX16                  kern;
   };
 
-  std::vector<OneGlyph> word_;
+  // Glyphs of the text with their location in font pixels, as laid out. The
+  // bitmaps are not kept: the font's bitmap cache holds them within its budget.
+  struct PlacedGlyph {
+    IBMFDefs::GlyphCode glyphCode;
+    bool                bypass; // The glyph being edited
+    int                 x;
+    int                 y;
+  };
+
+  // Lines of the layout, in font pixels. Tops and bottoms are made non
+  // decreasing from line to line, such that the lines intersecting some
+  // area are found by binary search.
+  struct Line {
+    int    top;
+    int    bottom;
+    size_t firstGlyph; // Index in glyphs_
+  };
+
+  std::vector<OneGlyph>    word_;
+  std::vector<PlacedGlyph> glyphs_;
+  std::vector<Line>        lines_;
+  int                      lineBaseline_{0}; // Of the last line in lines_
+  bool                     layoutValid_{false};
+  GlyphAtlas               atlas_; // Glyphs of the face at the pixel size
+
+  // Optical kerning edges of the glyphs of the face
+  static constexpr size_t             PROFILES_BUDGET = 1024 * 1024; // In bytes
+  GlyphLRU<IBMFFontMod::GlyphProfile> profiles_{PROFILES_BUDGET};
 
   QString        textToDraw_;
   IBMFFontModPtr font_;
+
+  std::vector<char32_t>            codePoints_; // textToDraw_ decoded
+  std::vector<IBMFDefs::GlyphCode> glyphCodes_; // codePoints_ translated, at each repaint
+
   int            faceIdx_;
   bool           opticalKerning_{false};
   bool           normalKerning_{false};
@@ -49,12 +84,17 @@ private:
   QSize          requiredSize_{QSize(0, 0)};
   QPoint         pos_{QPoint(0, 0)};
 
-  IBMFDefs::GlyphCode    bypassGlyphCode_{IBMFDefs::NO_GLYPH_CODE};
-  IBMFDefs::BitmapPtr    bypassBitmap_{nullptr};
-  IBMFDefs::GlyphInfoPtr bypassGlyphInfo_{nullptr};
+  IBMFDefs::GlyphCode       bypassGlyphCode_{IBMFDefs::NO_GLYPH_CODE};
+  IBMFDefs::BitmapPtr       bypassBitmap_{nullptr};
+  IBMFDefs::GlyphInfoPtr    bypassGlyphInfo_{nullptr};
+  QImage                    bypassImage_;
+  IBMFFontMod::GlyphProfile bypassProfile_;
 
-  auto computeAutoKerning(const BitmapPtr b1, const BitmapPtr b2, const GlyphInfo &i1,
-                          const GlyphInfo &i2) const -> FIX16;
-  auto paintWord(QPainter *painter, int lineHeight) -> void;
+  auto computeAutoKerning(IBMFDefs::GlyphCode g1, const BitmapPtr b1, IBMFDefs::GlyphCode g2,
+                          const BitmapPtr b2, const GlyphInfo &i1, const GlyphInfo &i2) -> FIX16;
+  auto glyphProfile(IBMFDefs::GlyphCode glyphCode, const BitmapPtr bitmap)
+      -> const IBMFFontMod::GlyphProfile &;
+  auto layout() -> void;
+  auto placeWord(int lineHeight) -> void;
   auto computeSize() -> void;
 };
@@ -5,7 +5,9 @@
 FreeType::FreeType() : initialized_(false), ftLib_(nullptr) {
   FT_Error error = FT_Init_FreeType(&ftLib_);
   if (error) {
-    QMessageBox::warning(nullptr, "Freetype Not Initialized", FT_Error_String(error));
+    const char *errorString = FT_Error_String(error);
+    lastErrorMessage_ =
+        std::string("Freetype Not Initialized: ") + (errorString ? errorString : "Unknown error");
   } else {
     initialized_ = true;
   }
@@ -28,13 +30,12 @@ FreeType::~FreeType() {
   }
 }
 
-FT_Face FreeType::openFace(QString filename) {
+FT_Face FreeType::openFace(const std::string &filename) {
   if (isInitialized()) {
     FT_Face  ftFace;
-    FT_Error error = FT_New_Face(ftLib_, filename.toStdString().c_str(), 0, &ftFace);
+    FT_Error error = FT_New_Face(ftLib_, filename.c_str(), 0, &ftFace);
     if (error) {
-      QMessageBox::warning(nullptr, "Unable to open font",
-                           QString("Not able to open font %1").arg(filename));
+      lastErrorMessage_ = "Not able to open font " + filename;
       return nullptr;
     }
     return ftFace;
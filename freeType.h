@@ -1,5 +1,7 @@
 #pragma once
 
+#include <string>
+
 #include <ft2build.h>
 #include FT_FREETYPE_H
 #include FT_GLYPH_H
@@ -9,12 +11,11 @@
 #include FT_DRIVER_H
 #include FT_MODULE_H
 
-#include <QMessageBox>
-
 class FreeType {
 private:
-  bool       initialized_;
-  FT_Library ftLib_;
+  bool        initialized_;
+  FT_Library  ftLib_;
+  std::string lastErrorMessage_;
 
 public:
   FreeType();
@@ -23,5 +24,8 @@ public:
   inline bool       isInitialized() { return initialized_; }
   inline FT_Library getLib() { return ftLib_; }
 
-  FT_Face openFace(QString filename);
+  // Description of the last issue encountered (initialization or openFace())
+  inline const std::string &getLastErrorMessage() const { return lastErrorMessage_; }
+
+  FT_Face openFace(const std::string &filename);
 };
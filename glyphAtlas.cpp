@@ -0,0 +1,33 @@
+#include "glyphAtlas.h"
+
+// The bitmap rows are already in the QImage::Format_Mono layout (one bit per
+// pixel, most significant bit first, rows padded to 64 bits). The image is
+// built in place from them, then converted and scaled by Qt.
+auto GlyphAtlas::toImage(const IBMFDefs::Bitmap &bitmap, int pixelSize, QColor color) -> QImage {
+  if ((bitmap.dim.width <= 0) || (bitmap.dim.height <= 0)) return QImage();
+
+  QImage mono(bitmap.rowPtr(0), bitmap.dim.width, bitmap.dim.height, bitmap.rowSize(),
+              QImage::Format_Mono);
+  mono.setColorTable({qRgba(0, 0, 0, 0), color.rgba()});
+
+  QImage image = mono.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+  if (pixelSize > 1) {
+    image = image.scaled(bitmap.dim.width * pixelSize, bitmap.dim.height * pixelSize,
+                         Qt::IgnoreAspectRatio, Qt::FastTransformation);
+  }
+  return image;
+}
+
+auto GlyphAtlas::put(IBMFDefs::GlyphCode glyphCode, const IBMFDefs::Bitmap &bitmap)
+    -> const QImage & {
+  QImage image = toImage(bitmap, pixelSize_, color_);
+  size_t size  = sizeof(QImage) + (static_cast<size_t>(image.bytesPerLine()) * image.height());
+  return images_.put(glyphCode, std::move(image), size);
+}
+
+auto GlyphAtlas::setPixelSize(int pixelSize) -> void {
+  if (pixelSize != pixelSize_) {
+    pixelSize_ = pixelSize;
+    images_.clear();
+  }
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <QColor>
+#include <QImage>
+
+#include "IBMFDriver/IBMFFontMod.hpp"
+#include "glyphLRU.h"
+
+// Glyphs of a face rendered as images at some pixel size, to be drawn with a
+// single drawImage() call each. Images are retrieved by glyph code: a glyph
+// modified in the font must be erased from the atlas. The least recently used
+// images are dropped beyond the budget, to be rendered again when required.
+
+class GlyphAtlas {
+public:
+  static constexpr size_t DEFAULT_BUDGET = 16 * 1024 * 1024; // In bytes
+
+  explicit GlyphAtlas(QColor color = QColorConstants::DarkGray, size_t budget = DEFAULT_BUDGET)
+      : color_(color), images_(budget) {}
+
+  // The bitmap as an image, each bitmap pixel being a square of pixelSize
+  // screen pixels. White pixels are transparent.
+  static auto toImage(const IBMFDefs::Bitmap &bitmap, int pixelSize, QColor color) -> QImage;
+
+  // nullptr if the image of the glyph is not in the atlas.
+  auto find(IBMFDefs::GlyphCode glyphCode) -> const QImage * { return images_.find(glyphCode); }
+
+  // The image of the bitmap retrieved with the glyph code, put in the atlas.
+  auto put(IBMFDefs::GlyphCode glyphCode, const IBMFDefs::Bitmap &bitmap) -> const QImage &;
+
+  auto setPixelSize(int pixelSize) -> void;
+  auto erase(IBMFDefs::GlyphCode glyphCode) -> void { images_.erase(glyphCode); }
+  auto clear() -> void { images_.clear(); }
+
+private:
+  QColor           color_;
+  int              pixelSize_{1};
+  GlyphLRU<QImage> images_;
+};
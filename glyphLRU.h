@@ -0,0 +1,73 @@
+#pragma once
+
+#include <list>
+#include <unordered_map>
+#include <utility>
+
+#include "IBMFDriver/IBMFDefs.hpp"
+
+// Values computed from the glyph bitmaps of a face (images, profiles), kept by
+// glyph code within a memory budget. As for the font's BitmapCache, the least
+// recently used values are dropped when the budget is exceeded. The two most
+// recently used values are always kept, such that a value retrieved stays
+// valid while a second one is retrieved.
+
+template <typename Value> class GlyphLRU {
+public:
+  explicit GlyphLRU(size_t budget) : budget_(budget) {}
+
+  // nullptr if absent.
+  auto find(IBMFDefs::GlyphCode glyphCode) -> Value * {
+    auto it = index_.find(glyphCode);
+    if (it == index_.end()) return nullptr;
+    lru_.splice(lru_.begin(), lru_, it->second);
+    return &it->second->value;
+  }
+
+  // size is the memory used by the value, in bytes.
+  auto put(IBMFDefs::GlyphCode glyphCode, Value value, size_t size) -> Value & {
+    erase(glyphCode);
+    lru_.push_front(Entry{.glyphCode = glyphCode, .value = std::move(value), .size = size});
+    index_[glyphCode] = lru_.begin();
+    size_ += size;
+    evict();
+    return lru_.front().value;
+  }
+
+  auto erase(IBMFDefs::GlyphCode glyphCode) -> void {
+    auto it = index_.find(glyphCode);
+    if (it != index_.end()) {
+      size_ -= it->second->size;
+      lru_.erase(it->second);
+      index_.erase(it);
+    }
+  }
+
+  auto clear() -> void {
+    lru_.clear();
+    index_.clear();
+    size_ = 0;
+  }
+
+private:
+  struct Entry {
+    IBMFDefs::GlyphCode glyphCode;
+    Value               value;
+    size_t              size;
+  };
+  typedef std::list<Entry>                                                    Entries;
+  typedef std::unordered_map<IBMFDefs::GlyphCode, typename Entries::iterator> Index;
+
+  size_t  budget_;
+  size_t  size_{0};
+  Entries lru_; // Most recently used first
+  Index   index_;
+
+  auto evict() -> void {
+    while ((size_ > budget_) && (lru_.size() > 2)) {
+      size_ -= lru_.back().size;
+      index_.erase(lru_.back().glyphCode);
+      lru_.pop_back();
+    }
+  }
+};
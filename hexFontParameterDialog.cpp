@@ -7,6 +7,7 @@
 #include <QFileDialog>
 #include <QFormLayout>
 #include <QHBoxLayout>
+#include <QMessageBox>
 #include <QSettings>
 
 #include "Unicode/UBlocks.hpp"
@@ -106,7 +107,8 @@ void HexFontParameterDialog::on_nextButton_clicked() {
     // codePointBlocks_  = blocksDialog->getCodePointBlocks();
 
     charSelections_->push_back(IBMFDefs::CharSelection(
-        {.filename = ui->hexFontFilename->text(), .selectedBlockIndexes = blockIndexes}));
+        {.filename             = ui->hexFontFilename->text().toStdString(),
+         .selectedBlockIndexes = blockIndexes}));
 
     fontParameters_ = IBMFDefs::FontParametersPtr(new IBMFDefs::FontParameters(
         IBMFDefs::FontParameters{.dpi = 75,
@@ -119,7 +121,7 @@ void HexFontParameterDialog::on_nextButton_clicked() {
                                  .pt17           = false,
                                  .pt24           = false,
                                  .pt48           = false,
-                                 .filename       = ui->ibmfFontFilename->text(),
+                                 .filename       = ui->ibmfFontFilename->text().toStdString(),
                                  .charSelections = charSelections_,
                                  .withKerning    = false}));
     accept();
@@ -5,9 +5,17 @@
 
 #include <QColor>
 #include <QDateTime>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFutureWatcher>
+#include <QInputDialog>
+#include <QProgressDialog>
 #include <QRegularExpression>
+#include <QSaveFile>
 #include <QSettings>
 #include <QTextStream>
+#include <QTimer>
+#include <QtConcurrent>
 
 #include "./ui_mainwindow.h"
 #include "IBMFDriver/IBMFHexImport.hpp"
@@ -447,34 +455,79 @@ bool MainWindow::saveFont(bool askToConfirmName) {
   if (newFilePath.isEmpty()) {
     return false;
   } else {
-    QFile outFile;
-    outFile.setFileName(newFilePath);
-    if (outFile.open(QIODevice::WriteOnly)) {
-      QDataStream out(&outFile);
-      if (ibmfFont_->save(out)) {
-        currentFilePath_ = newFilePath;
-        adjustRecentsForCurrentFile();
-        fontChanged_ = false;
-        setWindowTitle("IBMF Font Editor - " + currentFilePath_);
-        outFile.close();
-      } else {
-        outFile.close();
-        QMessageBox::critical(this, "Unable to save font!!", "Not able to save font!");
-        return false;
-      }
+    if (writeFont(*ibmfFont_, newFilePath)) {
+      currentFilePath_ = newFilePath;
+      adjustRecentsForCurrentFile();
+      fontChanged_ = false;
+      setWindowTitle("IBMF Font Editor - " + currentFilePath_);
     } else {
-      QMessageBox::critical(this, "Unable to save font!!", "Not able to save font!");
       return false;
     }
   }
   return true;
 }
 
+// The font is first saved in memory: the file is only written once the whole
+// font has been successfully encoded.
+
+bool MainWindow::writeFont(IBMFFontMod &font, const QString &filePath) {
+  std::vector<uint8_t> data;
+  VectorByteSink       out(data);
+  if (!font.save(out)) {
+    QMessageBox::critical(this, "Unable to save font!!",
+                          QString("Not able to save font: %1")
+                              .arg(QString::fromStdString(font.getLastErrorMessage())));
+    return false;
+  }
+
+  // A font loaded in place may still use the mapped file it is saved over: it
+  // is detached from it first. The file is then replaced only once completely
+  // written.
+  if (font.isInPlace()) font.detachMemory();
+
+  QSaveFile outFile(filePath);
+  if (!outFile.open(QIODevice::WriteOnly) ||
+      (outFile.write(reinterpret_cast<const char *>(data.data()), data.size()) !=
+       static_cast<qint64>(data.size())) ||
+      !outFile.commit()) {
+    QMessageBox::critical(this, "Unable to save font!!", "Not able to save font!");
+    return false;
+  }
+  return true;
+}
+
+// Non-fatal issues encountered while importing a font are shown to the user.
+
+void MainWindow::showImportWarnings(IBMFFontMod &font) {
+  if (!font.getWarnings().empty()) {
+    QString warnings;
+    for (auto &warning : font.getWarnings()) {
+      warnings += QString::fromStdString(warning) + "\n";
+    }
+    QMessageBox::warning(this, "Import Warnings", warnings);
+  }
+}
+
 bool MainWindow::loadFont(QFile &file) {
-  QByteArray content = file.readAll();
+  // The font is memory-mapped and used in place by the driver. The mapping is
+  // private (copy-on-write) and stays alive as long as the font is in use: the
+  // mapped file object is owned by the memory holder given to the driver.
+  // If the file cannot be mapped, its content is read in memory instead.
+  std::shared_ptr<uint8_t> memory;
+  qint64                   size       = file.size();
+  auto                     mappedFile = std::make_shared<QFile>(file.fileName());
+  if ((size > 0) && mappedFile->open(QIODevice::ReadOnly)) {
+    uchar *data = mappedFile->map(0, size, QFileDevice::MapPrivateOption);
+    if (data != nullptr) memory = std::shared_ptr<uint8_t>(mappedFile, data);
+  }
+  if (memory == nullptr) {
+    auto content = std::make_shared<QByteArray>(file.readAll());
+    size         = content->size();
+    memory       = std::shared_ptr<uint8_t>(content, (uint8_t *)content->data());
+  }
   file.close();
   clearAll();
-  ibmfFont_ = IBMFFontModPtr(new IBMFFontMod((uint8_t *)content.data(), content.size()));
+  ibmfFont_ = IBMFFontModPtr(new IBMFFontMod(memory, size));
   if (ibmfFont_->isInitialized()) {
     ibmfPreamble_ = ibmfFont_->getPreamble();
 
@@ -672,6 +725,7 @@ bool MainWindow::loadFace(uint8_t faceIdx) {
 
     faceReloading_ = false;
 
+    ibmfFont_->unpinGlyph(ibmfFaceIdx_, ibmfGlyphCode_);
     ibmfFaceIdx_   = faceIdx;
 
     loadGlyph(ibmfGlyphCode_);
@@ -704,18 +758,19 @@ void MainWindow::saveGlyph() {
 
     ibmfFont_->saveGlyph(ibmfFaceIdx_, ibmfGlyphCode_, &glyph_info, theBitmap);
     glyphChanged_ = false;
+    drawingSpace_->glyphChanged(ibmfGlyphCode_);
   }
 
-  drawingSpace_->repaint();
+  drawingSpace_->invalidateLayout();
 }
 
 void MainWindow::populateKernTable() {
   ui->kernTable->setRowCount(ibmfLigKerns_->kernSteps.size());
   for (int i = 0; i < ibmfLigKerns_->kernSteps.size(); i++) {
     putValue(ui->kernTable, i, 0,
-             QChar(ibmfFont_->getUTF32(ibmfLigKerns_->kernSteps[i]->nextGlyphCode)));
-    putFix16Value(ui->kernTable, i, 1, (float)ibmfLigKerns_->kernSteps[i]->kern / 64.0);
-    int      code      = ibmfLigKerns_->kernSteps[i]->nextGlyphCode;
+             QChar(ibmfFont_->getUTF32(ibmfLigKerns_->kernSteps[i].nextGlyphCode)));
+    putFix16Value(ui->kernTable, i, 1, (float)ibmfLigKerns_->kernSteps[i].kern / 64.0);
+    int      code      = ibmfLigKerns_->kernSteps[i].nextGlyphCode;
     char32_t codePoint = ibmfFont_->getUTF32(code);
     ui->kernTable->item(i, 0)->setToolTip(
         QString("%1: U+%2").arg(code).arg(codePoint, 4, 16, QChar('0')));
@@ -730,6 +785,9 @@ bool MainWindow::loadGlyph(uint16_t glyphCode) {
       (ibmfFaceIdx_ < ibmfPreamble_.faceCount) && (glyphCode < ibmfFaceHeader_->glyphCount)) {
 
     if (ibmfFont_->getGlyph(ibmfFaceIdx_, glyphCode, ibmfGlyphInfo_, &ibmfGlyphBitmap_)) {
+      // The glyph being edited stays in the driver's bitmap cache
+      ibmfFont_->unpinGlyph(ibmfFaceIdx_, ibmfGlyphCode_);
+      ibmfFont_->pinGlyph(ibmfFaceIdx_, glyphCode);
       ibmfGlyphCode_  = glyphCode;
 
       glyphChanged_   = false;
@@ -760,14 +818,14 @@ bool MainWindow::loadGlyph(uint16_t glyphCode) {
         ui->ligTable->setRowCount(ibmfLigKerns_->ligSteps.size());
         for (int i = 0; i < ibmfLigKerns_->ligSteps.size(); i++) {
           putValue(ui->ligTable, i, 0,
-                   QChar(ibmfFont_->getUTF32(ibmfLigKerns_->ligSteps[i]->nextGlyphCode)));
+                   QChar(ibmfFont_->getUTF32(ibmfLigKerns_->ligSteps[i].nextGlyphCode)));
           putValue(ui->ligTable, i, 1,
-                   QChar(ibmfFont_->getUTF32(ibmfLigKerns_->ligSteps[i]->replacementGlyphCode)));
-          int      code      = ibmfLigKerns_->ligSteps[i]->nextGlyphCode;
+                   QChar(ibmfFont_->getUTF32(ibmfLigKerns_->ligSteps[i].replacementGlyphCode)));
+          int      code      = ibmfLigKerns_->ligSteps[i].nextGlyphCode;
           char32_t codePoint = ibmfFont_->getUTF32(code);
           ui->ligTable->item(i, 0)->setToolTip(
               QString("%1: U+%2").arg(code).arg(codePoint, 4, 16, QChar('0')));
-          code      = ibmfLigKerns_->ligSteps[i]->replacementGlyphCode;
+          code      = ibmfLigKerns_->ligSteps[i].replacementGlyphCode;
           codePoint = ibmfFont_->getUTF32(code);
           ui->ligTable->item(i, 1)->setToolTip(
               QString("%1: U+%2").arg(code).arg(codePoint, 4, 16, QChar('0')));
@@ -1089,6 +1147,10 @@ void MainWindow::on_clearRecentList_triggered() {
 void MainWindow::on_actionImportTrueTypeFont_triggered() {
   if (checkFontChanged()) {
     if (ft_ == nullptr) ft_ = new FreeType();
+    if (!ft_->isInitialized()) {
+      QMessageBox::warning(this, "Freetype Not Initialized",
+                           QString::fromStdString(ft_->getLastErrorMessage()));
+    }
     TTFFontParameterDialog *fontDialog = new TTFFontParameterDialog(*ft_, "TrueType Font Import");
     if (fontDialog->exec() == QDialog::Accepted) {
       auto fontParameters         = fontDialog->getParameters();
@@ -1096,32 +1158,30 @@ void MainWindow::on_actionImportTrueTypeFont_triggered() {
       IBMFTTFImportPtr importFont = IBMFTTFImportPtr(new IBMFTTFImport);
 
       if (importFont->loadTTF(*ft_, fontParameters)) {
-        QFile outFile;
-        outFile.setFileName(fontParameters->filename);
-        if (outFile.open(QIODevice::WriteOnly)) {
-          QDataStream out(&outFile);
-          if (importFont->save(out)) {
-            outFile.close();
-            QFile file;
-            file.setFileName(fontParameters->filename);
-
-            if (!file.open(QIODevice::ReadOnly)) {
-              QMessageBox::warning(this, "Warning", "Unable to open file " + file.errorString());
+        showImportWarnings(*importFont);
+        QString filename = QString::fromStdString(fontParameters->filename);
+        if (writeFont(*importFont, filename)) {
+          QFile file;
+          file.setFileName(filename);
+
+          if (!file.open(QIODevice::ReadOnly)) {
+            QMessageBox::warning(this, "Warning", "Unable to open file " + file.errorString());
+          } else {
+            if (loadFont(file)) {
+              newFontLoaded(filename);
+              QFileInfo info = QFileInfo(filename);
+              QMessageBox::information(
+                  this, "Import Completed",
+                  QString("Import of TTF file to %1 completed!").arg(info.completeBaseName()));
             } else {
-              if (loadFont(file)) {
-                newFontLoaded(fontParameters->filename);
-                QFileInfo info = QFileInfo(fontParameters->filename);
-                QMessageBox::information(
-                    this, "Import Completed",
-                    QString("Import of TTF file to %1 completed!").arg(info.completeBaseName()));
-              } else {
-                QMessageBox::warning(this, "Warning",
-                                     "Unable to load IBMF file " + fontParameters->filename);
-              }
-              file.close();
+              QMessageBox::warning(this, "Warning", "Unable to load IBMF file " + filename);
             }
+            file.close();
           }
         }
+      } else {
+        QMessageBox::warning(this, "Import Failed",
+                             QString::fromStdString(importFont->getLastErrorMessage()));
       }
     }
   }
@@ -1133,8 +1193,10 @@ void MainWindow::on_editKerningButton_clicked() {
 
   if (kerningDialog->exec() == QDialog::Accepted) {
     model->save();
+    ibmfFont_->setGlyphLigKern(ibmfFaceIdx_, ibmfGlyphCode_, *ibmfLigKerns_);
     populateKernTable();
     ui->kernTable->update();
+    drawingSpace_->invalidateLayout();
   }
 }
 
@@ -1163,6 +1225,111 @@ void MainWindow::on_actionProofing_Tool_triggered() {
   }
 }
 
+// Kerning pairs of the glyphs in the selected Unicode blocks are computed from
+// the glyph shapes and written in the kerning tables of all faces.
+void MainWindow::on_actionOptical_Kerning_triggered() {
+  if (ibmfFont_ == nullptr) return;
+
+  int glyphCount = 0;
+  for (int faceIdx = 0; faceIdx < ibmfPreamble_.faceCount; faceIdx++) {
+    glyphCount = std::max<int>(glyphCount, ibmfFont_->getFaceHeader(faceIdx)->glyphCount);
+  }
+
+  GlyphCode    glyphCode = 0;
+  BlocksDialog blocksDialog(
+      [&](char32_t *charCode, bool first) -> bool {
+        if (first) glyphCode = 0;
+        if (glyphCode >= glyphCount) return false;
+        *charCode = ibmfFont_->getUTF32(glyphCode++);
+        return true;
+      },
+      [](char32_t ch, bool first) -> bool { return true; }, QFileInfo(currentFilePath_).fileName(),
+      this);
+  bool accepted = blocksDialog.exec() == QDialog::Accepted;
+
+  // The selected block indexes are not owned by the dialog
+  std::unique_ptr<SelectedBlockIndexes> blockIndexes(blocksDialog.getSelectedBlockIndexes());
+  if (!accepted) return;
+
+  std::vector<GlyphCode> glyphCodes;
+  for (glyphCode = 0; glyphCode < glyphCount; glyphCode++) {
+    char32_t ch = ibmfFont_->getUTF32(glyphCode);
+    for (auto idx : *blockIndexes) {
+      if ((uBlocks[idx].first_ <= ch) && (ch <= uBlocks[idx].last_)) {
+        glyphCodes.push_back(glyphCode);
+        break;
+      }
+    }
+  }
+  if (glyphCodes.empty()) return;
+
+  bool   ok;
+  double minKern = QInputDialog::getDouble(this, "Optical Kerning",
+                                           "Minimum kerning to keep (in pixels):", 0.5, 0.0,
+                                           16.0, 2, &ok);
+  if (!ok) return;
+
+  // The kerning is computed by a worker thread, the window modal progress
+  // dialog keeping the font from being modified until it is applied.
+  IBMFFontMod::AutoKerningProgress progress;
+  QProgressDialog progressDialog("Kerning the glyph pairs...", "Cancel", 0, 1000, this);
+  progressDialog.setWindowTitle("Optical Kerning");
+  progressDialog.setWindowModality(Qt::WindowModal);
+  progressDialog.setAutoReset(false);
+  progressDialog.setMinimumDuration(0);
+  connect(&progressDialog, &QProgressDialog::canceled,
+          [&progress]() { progress.canceled = true; });
+
+  QTimer progressTimer;
+  connect(&progressTimer, &QTimer::timeout, [&progress, &progressDialog]() {
+    uint64_t total = progress.firstGlyphCount;
+    if (total > 0) {
+      progressDialog.setValue(static_cast<int>((progress.doneFirstGlyphCount * 1000) / total));
+    }
+  });
+  progressTimer.start(100);
+
+  QElapsedTimer timer;
+  timer.start();
+  QFutureWatcher<IBMFFontMod::AutoKerning> watcher;
+  QEventLoop                               loop;
+  connect(&watcher, &QFutureWatcher<IBMFFontMod::AutoKerning>::finished, &loop,
+          &QEventLoop::quit);
+  const IBMFFontMod *ibmfFont = ibmfFont_.get();
+  watcher.setFuture(QtConcurrent::run([ibmfFont, &glyphCodes, minKern, &progress]() {
+    return ibmfFont->prepareAutoKerning(glyphCodes,
+                                        static_cast<IBMFDefs::FIX16>(minKern * 64.0), &progress);
+  }));
+  if (!watcher.isFinished()) loop.exec();
+  progressTimer.stop();
+  progressDialog.close();
+  if (progress.canceled) return;
+
+  IBMFFontMod::AutoKerningStats stats = ibmfFont_->applyAutoKerning(watcher.result());
+  double seconds = std::max<qint64>(timer.elapsed(), 1) / 1000.0;
+
+  if (stats.kernStepCount > 0) {
+    if (!fontChanged_) {
+      fontChanged_ = true;
+      this->setWindowTitle(this->windowTitle() + '*');
+    }
+    ibmfFont_->getGlyphLigKern(ibmfFaceIdx_, ibmfGlyphCode_, &ibmfLigKerns_);
+    populateKernTable();
+    ui->kernTable->update();
+    drawingSpace_->invalidateLayout();
+  }
+
+  QMessageBox::information(this, "Optical Kerning",
+                           QString("%1 pairs evaluated in %2 s (%3 pairs/s).\n"
+                                   "%4 kerning steps written, %5 left out for the "
+                                   "kerning tables to fit in the font.")
+                               .arg(stats.pairCount)
+                               .arg(seconds, 0, 'f', 2)
+                               .arg(static_cast<qint64>(stats.pairCount / seconds))
+                               .arg(stats.kernStepCount)
+                               .arg(stats.droppedKernStepCount));
+}
+
 void MainWindow::on_actionC_h_File_triggered() {
   if (ibmfFont_ != nullptr) {
     if (!checkFontChanged()) return;
@@ -1283,32 +1450,30 @@ void MainWindow::on_actionImportHexFont_triggered() {
       IBMFHexImportPtr importFont = IBMFHexImportPtr(new IBMFHexImport);
 
       if (importFont->loadHex(fontParameters)) {
-        QFile outFile;
-        outFile.setFileName(fontParameters->filename);
-        if (outFile.open(QIODevice::WriteOnly)) {
-          QDataStream out(&outFile);
-          if (importFont->save(out)) {
-            outFile.close();
-            QFile file;
-            file.setFileName(fontParameters->filename);
-
-            if (!file.open(QIODevice::ReadOnly)) {
-              QMessageBox::warning(this, "Warning", "Unable to open file " + file.errorString());
+        showImportWarnings(*importFont);
+        QString filename = QString::fromStdString(fontParameters->filename);
+        if (writeFont(*importFont, filename)) {
+          QFile file;
+          file.setFileName(filename);
+
+          if (!file.open(QIODevice::ReadOnly)) {
+            QMessageBox::warning(this, "Warning", "Unable to open file " + file.errorString());
+          } else {
+            if (loadFont(file)) {
+              newFontLoaded(filename);
+              QFileInfo info = QFileInfo(filename);
+              QMessageBox::information(this, "Import Completed",
+                                       QString("Import of GNU Hex file to %1 completed!")
+                                           .arg(info.completeBaseName()));
             } else {
-              if (loadFont(file)) {
-                newFontLoaded(fontParameters->filename);
-                QFileInfo info = QFileInfo(fontParameters->filename);
-                QMessageBox::information(this, "Import Completed",
-                                         QString("Import of GNU Hex file to %1 completed!")
-                                             .arg(info.completeBaseName()));
-              } else {
-                QMessageBox::warning(this, "Warning",
-                                     "Unable to load IBMF file " + fontParameters->filename);
-              }
-              file.close();
+              QMessageBox::warning(this, "Warning", "Unable to load IBMF file " + filename);
             }
+            file.close();
           }
         }
+      } else {
+        QMessageBox::warning(this, "Import Failed",
+                             QString::fromStdString(importFont->getLastErrorMessage()));
       }
     }
   }
@@ -74,6 +74,7 @@ private slots:
   void on_autoKernCheckBox_toggled(bool checked);
 
   void on_actionProofing_Tool_triggered();
+  void on_actionOptical_Kerning_triggered();
 
   void on_actionC_h_File_triggered();
 
@@ -126,6 +127,8 @@ private:
   void     adjustRecentsForCurrentFile();
   bool     checkFontChanged();
   bool     saveFont(bool askToConfirmName);
+  bool     writeFont(IBMFFontMod &font, const QString &filePath);
+  void     showImportWarnings(IBMFFontMod &font);
   void     newFontLoaded(QString filePath);
   bool     loadFont(QFile &file);
   bool     loadFace(uint8_t faceIdx);
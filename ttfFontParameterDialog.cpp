@@ -3,6 +3,7 @@
 #include <QDir>
 #include <QFileDialog>
 #include <QFormLayout>
+#include <QMessageBox>
 #include <QHBoxLayout>
 #include <QSettings>
 
@@ -109,7 +110,12 @@ void TTFFontParameterDialog::on_nextButton_clicked() {
   settings.setValue("ttfFolder", fileInfo.absolutePath());
 
   FT_UInt index              = 0;
-  FT_Face face               = ft_.openFace(ui->ttfFontFilename->text());
+  FT_Face face               = ft_.openFace(ui->ttfFontFilename->text().toStdString());
+  if (face == nullptr) {
+    QMessageBox::warning(this, "Unable to open font",
+                         QString::fromStdString(ft_.getLastErrorMessage()));
+    return;
+  }
 
   BlocksDialog *blocksDialog = new BlocksDialog(
       [&index, &face](char32_t *charCode, bool first) -> bool {
@@ -127,7 +133,8 @@ void TTFFontParameterDialog::on_nextButton_clicked() {
     // codePointBlocks_  = blocksDialog->getCodePointBlocks();
 
     charSelections_->push_back(IBMFDefs::CharSelection(
-        {.filename = ui->ttfFontFilename->text(), .selectedBlockIndexes = blockIndexes}));
+        {.filename             = ui->ttfFontFilename->text().toStdString(),
+         .selectedBlockIndexes = blockIndexes}));
 
     fontParameters_ = IBMFDefs::FontParametersPtr(new IBMFDefs::FontParameters(
         IBMFDefs::FontParameters{.dpi = ui->dpiNbr->text().toInt() != 0 ? ui->dpiNbr->text().toInt()
@@ -146,7 +153,7 @@ void TTFFontParameterDialog::on_nextButton_clicked() {
                                  .pt17           = ui->pt17->isChecked(),
                                  .pt24           = ui->pt24->isChecked(),
                                  .pt48           = ui->pt48->isChecked(),
-                                 .filename       = ui->ibmfFontFilename->text(),
+                                 .filename       = ui->ibmfFontFilename->text().toStdString(),
                                  .charSelections = charSelections_,
                                  .withKerning    = ui->withKerning->isChecked()}));
     accept();